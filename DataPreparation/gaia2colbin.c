@@ -0,0 +1,122 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "gaiastar.h"
+#include "gaia2zone.h"
+
+// Rewrites the sorted zone files (sortedBin/z1 ... z900, see gaia2datasort.c) in the column layout read by
+// gaia2read --layout columns: a zonecolheader followed by one array per gaiastar field, in the order of
+// gaiastar_fields. The stars keep the order of sortedBin so the ra zone counts are copied as they are.
+
+// local functions
+char *concat(const char *s1, const char *s2);
+int writeColBin(FILE* binFile, char* fileName);
+
+// main method
+int main(void)
+{
+  char* catpath = "/home/jkim/work/Gaia2Bin/sortedBin/z";
+  char* colpath = "/home/jkim/work/Gaia2Bin/sortedCol/z";
+
+  for(int z = 1; z < 901; z++)
+    {
+      char buffer[12];
+      sprintf(buffer,"%d",z);
+      char *fileName = concat(catpath, buffer);
+      char *colName = concat(colpath, buffer);
+
+      printf("%s\n",colName);
+      FILE *binFile = fopen(fileName,"rb");
+      if ( binFile == NULL )
+        {
+          printf("error: could not open file %s\n",fileName);
+          exit(EXIT_FAILURE);
+        }
+      if (writeColBin(binFile,colName) != 0)
+        exit(EXIT_FAILURE);
+
+      fclose(binFile);
+      free(fileName);
+      free(colName);
+    }
+
+  return 0;
+}
+
+// string concatenation
+char *concat(const char *s1, const char *s2)
+{
+  char *result;
+
+  result = malloc(strlen(s1) + strlen(s2) + 1);
+  if (result == NULL)
+    {
+      printf("Error: malloc failed in concat\n");
+      exit(EXIT_FAILURE);
+    }
+  strcpy(result, s1);
+  strcat(result, s2);
+  return result;
+}
+
+// reads a sortedBin zone file and writes it column by column
+int writeColBin(FILE* binFile, char* fileName)
+{
+  zonecolheader header;
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,ZONE_COLMAGIC,sizeof(header.magic));
+  header.version = ZONE_COLVERSION;
+  header.numFields = GAIASTAR_NFIELDS;
+
+  if (fread(header.raZones,sizeof(int),GAIA2_NRAZONES,binFile) != GAIA2_NRAZONES)
+    {
+      printf("error: missing ra zones in %s\n",fileName);
+      return 1;
+    }
+
+  fseek(binFile,0,SEEK_END);
+  long numStars = (ftell(binFile) - GAIA2_NRAZONES*sizeof(int))/sizeof(gaiastar);
+  fseek(binFile,GAIA2_NRAZONES*sizeof(int),SEEK_SET);
+
+  gaiastar *stars = malloc((numStars > 0 ? numStars : 1)*sizeof(gaiastar));
+  if (stars == NULL || (long)fread(stars,sizeof(gaiastar),numStars,binFile) != numStars)
+    {
+      printf("error: could not read the stars of %s\n",fileName);
+      free(stars);
+      return 1;
+    }
+  header.numStars = numStars;
+
+  // every column starts 8 byte aligned after the header
+  long offset = (sizeof(header) + 7) & ~7L;
+  for (int f = 0; f < GAIASTAR_NFIELDS; f++)
+    {
+      header.columns[f] = offset;
+      offset += (numStars*gaiastar_fields[f].size + 7) & ~7L;
+    }
+
+  FILE *outFile = fopen(fileName,"wb");
+  if (outFile == NULL)
+    {
+      printf("error: could not open file %s\n",fileName);
+      free(stars);
+      return 1;
+    }
+  fwrite(&header,sizeof(header),1,outFile);
+
+  static const char padding[8];
+  long position = sizeof(header);
+  for (int f = 0; f < GAIASTAR_NFIELDS; f++)
+    {
+      fwrite(padding,1,header.columns[f] - position,outFile);
+      for (long i = 0; i < numStars; i++)
+        fwrite((char*)&stars[i] + gaiastar_fields[f].offset,gaiastar_fields[f].size,1,outFile);
+      position = header.columns[f] + numStars*gaiastar_fields[f].size;
+    }
+  fwrite(padding,1,offset - position,outFile);
+
+  free(stars);
+  return fclose(outFile) == 0 ? 0 : 1;
+}
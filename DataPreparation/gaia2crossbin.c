@@ -0,0 +1,225 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gaia2crossid.h"
+
+// Writes the cross-ID store (IDcross, see gaia2crossid.h) read by gaia2read from the cross-ID rows sorted by Gaia
+// id (IDgaiaSort). The arguments are the input and the output file, by default in /home/jkim/work/Gaia2Mass.
+// The input is read four times: to count the rows, to write the 2MASS and HAT columns and the Gaia ids, and once
+// for each row permutation, which is sorted in memory (12 bytes per row).
+
+// rows read at once
+#define SCANBLOCK 4096
+
+// IDs of the rows while the permutations are sorted
+static const long *sortKeys;
+
+// orders rows by their ID, then by row number so equal IDs always come out the same way
+int permcmp(const void *a, const void *b)
+{
+  unsigned int r1 = *(const unsigned int*)a;
+  unsigned int r2 = *(const unsigned int*)b;
+  if (sortKeys[r1] != sortKeys[r2])
+    return sortKeys[r1] < sortKeys[r2] ? -1 : 1;
+  return (r1 > r2) - (r1 < r2);
+}
+
+// writes count items at a byte offset of the output
+void writeAt(FILE *out, long offset, const void *data, size_t size, long count, const char *outName)
+{
+  if (fseek(out,offset,SEEK_SET) != 0 || fwrite(data,size,count,out) != (size_t)count)
+    {
+      printf("error: could not write %s\n",outName);
+      exit(EXIT_FAILURE);
+    }
+}
+
+// appends the base 128 varint of a difference of Gaia ids to buffer, returns its length
+int putVarint(unsigned char *buffer, unsigned long value)
+{
+  int n = 0;
+  while (value >= 0x80)
+    {
+      buffer[n++] = (unsigned char)(value | 0x80);
+      value >>= 7;
+    }
+  buffer[n++] = (unsigned char)value;
+  return n;
+}
+
+// sorts the rows with a nonzero ID of the column and writes their permutation, returns the number of rows
+long writePerm(FILE *out, long offset, const long column[], long numRows, long count, const char *outName)
+{
+  unsigned int *perm = malloc((count > 0 ? count : 1)*sizeof(unsigned int));
+  if (perm == NULL)
+    {
+      printf("error: malloc failed\n");
+      exit(EXIT_FAILURE);
+    }
+  long n = 0;
+  for (long r = 0; r < numRows; r++)
+    if (column[r] != 0)
+      perm[n++] = (unsigned int)r;
+  sortKeys = column;
+  qsort(perm,n,sizeof(unsigned int),permcmp);
+  writeAt(out,offset,perm,sizeof(unsigned int),n,outName);
+  free(perm);
+  return n;
+}
+
+// main method
+int main(int argc, char** argv)
+{
+  const char *inName = argc > 1 ? argv[1] : "/home/jkim/work/Gaia2Mass/IDgaiaSort";
+  const char *outName = argc > 2 ? argv[2] : "/home/jkim/work/Gaia2Mass/IDcross";
+
+  FILE *in = fopen(inName,"rb");
+  if (in == NULL)
+    {
+      printf("error: could not open file %s\n",inName);
+      exit(EXIT_FAILURE);
+    }
+  fseek(in,0,SEEK_END);
+  long numRows = ftell(in)/sizeof(crossidrecord);
+  if (numRows > 0xffffffffL)
+    {
+      printf("error: %ld rows do not fit the 32 bit row numbers\n",numRows);
+      exit(EXIT_FAILURE);
+    }
+  long numBlocks = (numRows + CROSSID_BLOCK - 1)/CROSSID_BLOCK;
+
+  crossidrecord *rows = malloc(SCANBLOCK*sizeof(crossidrecord));
+  long *column = malloc(SCANBLOCK*sizeof(long));
+  long *blocks = malloc((numBlocks > 0 ? 2*numBlocks : 1)*sizeof(long));
+  unsigned char *varints = malloc(SCANBLOCK*10);
+  if (rows == NULL || column == NULL || blocks == NULL || varints == NULL)
+    {
+      printf("error: malloc failed\n");
+      exit(EXIT_FAILURE);
+    }
+
+  // first pass: the rows with a 2MASS and a HAT ID, and the order of the Gaia ids
+  crossidheader header;
+  memset(&header,0,sizeof(crossidheader));
+  long previous = 0;
+  fseek(in,0,SEEK_SET);
+  for (long start = 0; start < numRows; start += SCANBLOCK)
+    {
+      long count = numRows - start < SCANBLOCK ? numRows - start : SCANBLOCK;
+      if (fread(rows,sizeof(crossidrecord),count,in) != (size_t)count)
+        {
+          printf("error: could not read %s\n",inName);
+          exit(EXIT_FAILURE);
+        }
+      for (long i = 0; i < count; i++)
+        {
+          if (start + i > 0 && rows[i].gaia < previous)
+            {
+              printf("error: %s is not sorted by Gaia id at row %ld\n",inName,start + i);
+              exit(EXIT_FAILURE);
+            }
+          previous = rows[i].gaia;
+          header.numTmass += rows[i].tmass != 0;
+          header.numHat += rows[i].hat != 0;
+        }
+    }
+
+  memcpy(header.magic,CROSSID_MAGIC,sizeof(header.magic));
+  header.version = CROSSID_VERSION;
+  header.blockSize = CROSSID_BLOCK;
+  header.numRows = numRows;
+  header.numBlocks = numBlocks;
+  header.tmassOffset = CROSSID_DATAOFFSET;
+  header.hatOffset = header.tmassOffset + numRows*sizeof(long);
+  header.tmassPermOffset = header.hatOffset + numRows*sizeof(long);
+  header.hatPermOffset = header.tmassPermOffset + header.numTmass*sizeof(unsigned int);
+  header.gaiaOffset = header.hatPermOffset + header.numHat*sizeof(unsigned int);
+
+  FILE *out = fopen(outName,"wb");
+  if (out == NULL)
+    {
+      printf("error: could not open file %s\n",outName);
+      exit(EXIT_FAILURE);
+    }
+
+  // second pass: the 2MASS and HAT columns, the Gaia ids as varints and the block index
+  long gaiaSize = 0;
+  fseek(in,0,SEEK_SET);
+  for (long start = 0; start < numRows; start += SCANBLOCK)
+    {
+      long count = numRows - start < SCANBLOCK ? numRows - start : SCANBLOCK;
+      if (fread(rows,sizeof(crossidrecord),count,in) != (size_t)count)
+        {
+          printf("error: could not read %s\n",inName);
+          exit(EXIT_FAILURE);
+        }
+      for (long i = 0; i < count; i++)
+        column[i] = rows[i].tmass;
+      writeAt(out,header.tmassOffset + start*sizeof(long),column,sizeof(long),count,outName);
+      for (long i = 0; i < count; i++)
+        column[i] = rows[i].hat;
+      writeAt(out,header.hatOffset + start*sizeof(long),column,sizeof(long),count,outName);
+
+      // SCANBLOCK is a multiple of CROSSID_BLOCK, so the blocks start within this read
+      long length = 0;
+      for (long i = 0; i < count; i++)
+        {
+          long row = start + i;
+          if (row % CROSSID_BLOCK == 0)
+            {
+              blocks[2*(row/CROSSID_BLOCK)] = rows[i].gaia;
+              blocks[2*(row/CROSSID_BLOCK)+1] = gaiaSize + length;
+            }
+          else
+            length += putVarint(varints + length,(unsigned long)(rows[i].gaia - rows[i-1].gaia));
+        }
+      writeAt(out,header.gaiaOffset + gaiaSize,varints,1,length,outName);
+      gaiaSize += length;
+    }
+  header.gaiaSize = gaiaSize;
+  header.blockOffset = (header.gaiaOffset + gaiaSize + sizeof(long) - 1)/sizeof(long)*sizeof(long);
+  writeAt(out,header.blockOffset,blocks,sizeof(long),2*numBlocks,outName);
+  free(blocks);
+  free(varints);
+  free(column);
+
+  // last passes: the rows in the order of their 2MASS and of their HAT IDs
+  long *keys = malloc((numRows > 0 ? numRows : 1)*sizeof(long));
+  if (keys == NULL)
+    {
+      printf("error: malloc failed\n");
+      exit(EXIT_FAILURE);
+    }
+  for (int pass = 0; pass < 2; pass++)
+    {
+      fseek(in,0,SEEK_SET);
+      for (long start = 0; start < numRows; start += SCANBLOCK)
+        {
+          long count = numRows - start < SCANBLOCK ? numRows - start : SCANBLOCK;
+          if (fread(rows,sizeof(crossidrecord),count,in) != (size_t)count)
+            {
+              printf("error: could not read %s\n",inName);
+              exit(EXIT_FAILURE);
+            }
+          for (long i = 0; i < count; i++)
+            keys[start + i] = pass == 0 ? rows[i].tmass : rows[i].hat;
+        }
+      if (pass == 0)
+        writePerm(out,header.tmassPermOffset,keys,numRows,header.numTmass,outName);
+      else
+        writePerm(out,header.hatPermOffset,keys,numRows,header.numHat,outName);
+    }
+  free(keys);
+  free(rows);
+  fclose(in);
+
+  writeAt(out,0,&header,sizeof(crossidheader),1,outName);
+  if (fclose(out) != 0)
+    {
+      printf("error: could not write %s\n",outName);
+      exit(EXIT_FAILURE);
+    }
+  printf("%s: %ld rows, %ld with a 2MASS ID, %ld with a HAT ID\n",outName,numRows,header.numTmass,header.numHat);
+  return 0;
+}
@@ -3,49 +3,120 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "gaiastar.h"
 
+// PARALLEL SORT:
+// The zone files of gaia2writebin.c are sorted by ra by worker threads, one zone at a time per worker (the
+// number of threads is the first argument, all cpus by default). A zone is read whole, so a worker first
+// reserves the memory the zone needs from a budget shared by the workers (the second argument in MB, half
+// of the physical memory by default) and waits while the other workers hold too much of it. A zone larger
+// than the budget is sorted when no other zone is in memory.
+//
+// RADIX SORT:
+// The stars are not sorted with qsort on the gaiastar records. The ra of each record is turned into an
+// unsigned key with the same order as the double, and the (key, record index) pairs are sorted with an LSD
+// radix sort of RADIXBITS bits per pass. The histograms of all passes and the 1440 ra zone counts are built
+// in the same pass over the records, and the passes in which all keys have the same digit are skipped.
+// The records are then converted to gaiastar in sorted order and written in blocks of SORTBLOCK stars.
+
+#define NZONES 900
+
+// a zone file record: the source id and 48 values, the ra is value 1
+#define RECORDSIZE (sizeof(unsigned long long) + 48*sizeof(double))
+#define RAOFFSET (sizeof(unsigned long long) + sizeof(double))
+
+// ra zones of 0.25 deg at the head of a sorted zone file
+#define NRAZONES 1440
+
+#define RADIXBITS 8
+#define RADIXPASSES (64/RADIXBITS)
+#define RADIXSIZE (1 << RADIXBITS)
+
+// stars converted and written at once
+#define SORTBLOCK 4096
+
+// the memory budget of the workers and the next zone to sort
+typedef struct
+{
+  int next;                   // next zone to hand out
+  size_t budget;              // bytes
+  size_t used;
+  pthread_mutex_t lock;       // for next and used
+  pthread_cond_t released;    // signalled when a worker gives memory back
+} sortjob;
+
+// a star to sort: the key of its ra and its index in the zone file
+typedef struct
+{
+  uint64_t key;
+  long index;
+} sortkey;
+
 // local functions
 char *concat(const char *s1, const char *s2);
-int rwBin(FILE* binFile, char* buffer);
+gaiastar convertData(unsigned long long sID, double dataArray[]);
+uint64_t raKey(double ra);
+void radixSort(sortkey keys[], sortkey temp[], long numStars, long counts[RADIXPASSES][RADIXSIZE]);
+long removeDuplicates(const char *records, sortkey keys[], long *numStars, int raZones[]);
+int sortZone(sortjob *job, int z);
+void *sortZones(void *arg);
 
 // main method
-int main(void)
+int main(int argc, char *argv[])
 {
-  char* catpath = "/home/jkim/work/Gaia2Bin/binFiles2/z";
-  /*DIR *d;
-  struct dirent *dir;
-  d = opendir(catpath);
-  if (d)
-    {
-     
-        while ((dir = readdir(d)) != NULL)*/
-  for(int z = 1; z < 901; z++)
-    {
-      char buffer[3];
-      sprintf(buffer,"%d",z);
-	  // if ((dir->d_name)[0]!='z')
-	  // continue;                                                                                                                                                                 
-          char *fileName = concat(catpath, buffer);
-	  
-	  printf("%s\n",fileName);
-          FILE *binFile;
-          binFile = fopen(fileName,"rb");
-
-          if ( binFile == NULL )
-            {
-              printf("error: could not open file\n");
-            }
-	  rwBin(binFile,buffer);
+  int numThreads = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (numThreads < 1)
+    numThreads = 1;
 
-        }
-	//    closedir(d);
-	// }
+  sortjob job;
+  job.next = 1;
+  job.used = 0;
+  if (argc > 2)
+    job.budget = (size_t)atol(argv[2]) << 20;
+  else
+    job.budget = (size_t)sysconf(_SC_PHYS_PAGES)*(size_t)sysconf(_SC_PAGESIZE)/2;
+  pthread_mutex_init(&job.lock, NULL);
+  pthread_cond_init(&job.released, NULL);
+
+  pthread_t *threads = malloc(numThreads*sizeof(pthread_t));
+  if (threads == NULL)
+    {
+      printf("Error: malloc failed for %d workers\n", numThreads);
+      exit(EXIT_FAILURE);
+    }
+  for (int t = 0; t < numThreads; t++)
+    if (pthread_create(&threads[t], NULL, sortZones, &job) != 0)
+      {
+        printf("error: could not start worker %d\n", t);
+        exit(EXIT_FAILURE);
+      }
+  for (int t = 0; t < numThreads; t++)
+    pthread_join(threads[t], NULL);
+  free(threads);
 
   return 0;
 }
 
+// worker thread: takes the zones one by one
+void *sortZones(void *arg)
+{
+  sortjob *job = arg;
+  for (;;)
+    {
+      pthread_mutex_lock(&job->lock);
+      int z = job->next <= NZONES ? job->next++ : 0;
+      pthread_mutex_unlock(&job->lock);
+      if (z == 0)
+        break;
+      sortZone(job, z);
+    }
+  return NULL;
+}
+
 // string concatenation
 char *concat(const char *s1, const char *s2)
 {
@@ -62,17 +133,6 @@ char *concat(const char *s1, const char *s2)
   return result;
 }
 
-
-int writeSortBin(gaiastar starsArr[], int raZones[], char *fileName, int numStars)
-{
-  FILE *outFile = fopen(fileName,"wb");
-  fwrite(raZones,sizeof(int),1440,outFile);
-  fwrite(starsArr,sizeof(gaiastar),numStars,outFile);
- 
-  fclose(outFile);
-  return 0;
-}
-
 gaiastar convertData(unsigned long long sID, double dataArray[])
 {
   gaiastar st;
@@ -91,10 +151,11 @@ gaiastar convertData(unsigned long long sID, double dataArray[])
   st.pmdec_error = dataArray[10];
   st.astrometric_excess_noise = dataArray[11];
   st.astrometric_excess_noise_sig = dataArray[12];
-  if(dataArray[13]==6.55)
-    st.astrometric_primary_flag = false;
-  else
+  // the flags are true only for their true value (7.55, 5.55), a value the release does not have (3.55) is false
+  if(dataArray[13]==7.55)
     st.astrometric_primary_flag = true;
+  else
+    st.astrometric_primary_flag = false;
 
   st.phot_g_n_obs =(int) dataArray[14];
   st.phot_g_mean_flux = dataArray[15];
@@ -114,10 +175,10 @@ gaiastar convertData(unsigned long long sID, double dataArray[])
   st.phot_bp_rp_excess_factor =(float) dataArray[29];
   st.radial_velocity = dataArray[30];
   st.radial_velocity_error = dataArray[31];
-  if(dataArray[32]==4.55)
-    st.phot_variable_flag = false;
-  else
+  if(dataArray[32]==5.55)
     st.phot_variable_flag = true;
+  else
+    st.phot_variable_flag = false;
   st.teff_val =(float) dataArray[33];
   st.teff_percentile_lower =(float) dataArray[34];
   st.teff_percentile_upper =(float) dataArray[35];
@@ -136,53 +197,202 @@ gaiastar convertData(unsigned long long sID, double dataArray[])
   return st;
 }
 
+// key with the order of the double: the sign bit is set for the positive values and all bits are flipped
+// for the negative ones
+uint64_t raKey(double ra)
+{
+  uint64_t bits;
+  memcpy(&bits, &ra, sizeof(bits));
+  return (bits >> 63) ? ~bits : bits | ((uint64_t)1 << 63);
+}
+
+// LSD radix sort of the keys with the histograms of every digit. Stable, so stars with the same ra keep
+// the order of the zone file. The sorted keys end up in keys
+void radixSort(sortkey keys[], sortkey temp[], long numStars, long counts[RADIXPASSES][RADIXSIZE])
+{
+  sortkey *from = keys;
+  sortkey *to = temp;
+  for (int pass = 0; pass < RADIXPASSES; pass++)
+    {
+      long *count = counts[pass];
+      int shift = pass*RADIXBITS;
+      if (numStars == 0 || count[(from[0].key >> shift) & (RADIXSIZE - 1)] == numStars)
+        continue;
+
+      long offset = 0;
+      for (int d = 0; d < RADIXSIZE; d++)
+        {
+          long n = count[d];
+          count[d] = offset;
+          offset += n;
+        }
+      for (long i = 0; i < numStars; i++)
+        to[count[(from[i].key >> shift) & (RADIXSIZE - 1)]++] = from[i];
+
+      sortkey *swap = from;
+      from = to;
+      to = swap;
+    }
+  if (from != keys)
+    memcpy(keys, from, numStars*sizeof(sortkey));
+}
+
+// removes the stars that are more than once in the zone file, which happens when an interrupted gaia2writebin.c
+// is resumed (see CHECKPOINTS there). The copies of a star have the same ra, so they are next to each other in
+// the sorted keys among the stars with that ra. The first copy is kept. Returns the number of stars removed
+long removeDuplicates(const char *records, sortkey keys[], long *numStars, int raZones[])
+{
+  long kept = 0;
+  for (long i = 0; i < *numStars; i++)
+    {
+      unsigned long long sID;
+      memcpy(&sID, records + keys[i].index*RECORDSIZE, sizeof(sID));
+      bool duplicate = false;
+      for (long j = kept - 1; j >= 0 && keys[j].key == keys[i].key && !duplicate; j--)
+        {
+          unsigned long long other;
+          memcpy(&other, records + keys[j].index*RECORDSIZE, sizeof(other));
+          duplicate = other == sID;
+        }
+      if (!duplicate)
+        {
+          keys[kept++] = keys[i];
+          continue;
+        }
 
-int rwBin(FILE* binFile, char* buffer)
+      double ra;
+      memcpy(&ra, records + keys[i].index*RECORDSIZE + RAOFFSET, sizeof(ra));
+      int zone = (int)(ra/0.25);
+      if (ra == 360.0)
+        zone = 1439;
+      raZones[zone]--;
+    }
+  long removed = *numStars - kept;
+  *numStars = kept;
+  return removed;
+}
+
+// sorts zone file z by ra into sortedBin. Returns non-zero if the zone could not be sorted
+int sortZone(sortjob *job, int z)
 {
-  int raZones[1440] = {0};
+  char buffer[12];
+  sprintf(buffer,"%d",z);
+  char *fileName = concat("/home/jkim/work/Gaia2Bin/binFiles2/z", buffer);
+  char *outName = concat("/home/jkim/work/Gaia2Bin/sortedBin/z", buffer);
+  printf("%s\n",fileName);
 
+  FILE *binFile = fopen(fileName,"rb");
+  if ( binFile == NULL )
+    {
+      printf("error: could not open file %s\n",fileName);
+      free(fileName);
+      free(outName);
+      return 1;
+    }
   fseek(binFile, 0L, SEEK_END);
-  int numStars = ftell(binFile)/(8*49);
+  long size = ftell(binFile);
+  // a partial record would shift every record after it, gaia2writebin.c truncates them when it resumes
+  if (size % RECORDSIZE != 0)
+    {
+      printf("error: %s ends with a partial record (%ld bytes), resume gaia2writebin to repair it\n",fileName,size);
+      exit(EXIT_FAILURE);
+    }
+  long numStars = size/RECORDSIZE;
   rewind(binFile);
-  //  gaiastar starsArr[numStars];
 
-  gaiastar *starsArr = malloc(numStars*sizeof(gaiastar));
-    if(starsArr==NULL)
+  // the records, two key arrays and a block of output stars
+  size_t need = numStars*(RECORDSIZE + 2*sizeof(sortkey)) + SORTBLOCK*sizeof(gaiastar);
+  pthread_mutex_lock(&job->lock);
+  while (job->used > 0 && job->used + need > job->budget)
+    pthread_cond_wait(&job->released, &job->lock);
+  job->used += need;
+  pthread_mutex_unlock(&job->lock);
+
+  char *records = malloc((numStars > 0 ? numStars : 1)*RECORDSIZE);
+  sortkey *keys = malloc((numStars > 0 ? 2*numStars : 1)*sizeof(sortkey));
+  gaiastar *block = malloc(SORTBLOCK*sizeof(gaiastar));
+  if (records == NULL || keys == NULL || block == NULL)
     {
-      printf("ERROR in MEMORY allocation");
+      printf("ERROR in MEMORY allocation for %ld stars of %s\n",numStars,fileName);
       exit(EXIT_FAILURE);
-      }
-  unsigned long long sID;
-  int starCount = 0;
-   while(fread((void*)(&sID),sizeof(sID),1,binFile)==1)
+    }
+  numStars = fread(records, RECORDSIZE, numStars, binFile);
+  fclose(binFile);
+
+  // keys, digit histograms and ra zones in one pass
+  int raZones[NRAZONES] = {0};
+  static long countsInit[RADIXPASSES][RADIXSIZE];
+  long (*counts)[RADIXSIZE] = malloc(sizeof(countsInit));
+  if (counts == NULL)
     {
-      double dataArray[48];
-      fread((void*)(&dataArray),sizeof(double),48,binFile);
-      gaiastar newStar = convertData(sID, dataArray);
-
-      int zone = (int)((newStar.ra)/0.25);
-      if(newStar.ra == 360.0)
-	zone = 1439;
-       raZones[zone]++;
-              
-       starsArr[starCount] =newStar;
-      starCount++;
-      
+      printf("ERROR in MEMORY allocation for %s\n",fileName);
+      exit(EXIT_FAILURE);
     }
+  memset(counts, 0, sizeof(countsInit));
+  for (long i = 0; i < numStars; i++)
+    {
+      double ra;
+      memcpy(&ra, records + i*RECORDSIZE + RAOFFSET, sizeof(ra));
+      uint64_t key = raKey(ra);
+      keys[i].key = key;
+      keys[i].index = i;
+      for (int pass = 0; pass < RADIXPASSES; pass++)
+        counts[pass][(key >> (pass*RADIXBITS)) & (RADIXSIZE - 1)]++;
+
+      int zone = (int)(ra/0.25);
+      if (ra == 360.0)
+        zone = 1439;
+      raZones[zone]++;
+    }
+  radixSort(keys, keys + numStars, numStars, counts);
+  free(counts);
+
+  long duplicates = removeDuplicates(records, keys, &numStars, raZones);
+  if (duplicates > 0)
+    printf("%s: %ld duplicated stars removed\n", fileName, duplicates);
 
-  fclose(binFile);
-    
-  qsort(starsArr,starCount,sizeof(gaiastar),starcmp);
-  
   int sum = 0;
-  for (int i = 0; i < 1440; i++)
+  for (int i = 0; i < NRAZONES; i++)
     {
       sum = sum + raZones[i];
       raZones[i] = sum;
     }
-  //char *outFile = concat(fileName, "sort");
-  char *outFile = concat("/home/jkim/work/Gaia2Bin/sortedBin/z",buffer);
-  writeSortBin(starsArr, raZones,outFile, numStars);
-  free(starsArr);
+
+  FILE *outFile = fopen(outName,"wb");
+  if (outFile == NULL || fwrite(raZones,sizeof(int),NRAZONES,outFile) != NRAZONES)
+    {
+      printf("error: could not write %s\n",outName);
+      exit(EXIT_FAILURE);
+    }
+  for (long start = 0; start < numStars; start += SORTBLOCK)
+    {
+      long n = numStars - start < SORTBLOCK ? numStars - start : SORTBLOCK;
+      for (long i = 0; i < n; i++)
+        {
+          const char *record = records + keys[start+i].index*RECORDSIZE;
+          unsigned long long sID;
+          double dataArray[48];
+          memcpy(&sID, record, sizeof(sID));
+          memcpy(dataArray, record + sizeof(sID), sizeof(dataArray));
+          block[i] = convertData(sID, dataArray);
+        }
+      if (fwrite(block,sizeof(gaiastar),n,outFile) != (size_t)n)
+        {
+          printf("error: could not write %s\n",outName);
+          exit(EXIT_FAILURE);
+        }
+    }
+  fclose(outFile);
+
+  free(records);
+  free(keys);
+  free(block);
+  free(fileName);
+  free(outName);
+
+  pthread_mutex_lock(&job->lock);
+  job->used -= need;
+  pthread_cond_broadcast(&job->released);
+  pthread_mutex_unlock(&job->lock);
   return 0;
-}         
+}
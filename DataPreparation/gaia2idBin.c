@@ -21,16 +21,30 @@ char *concat(const char *s1, const char *s2)
   return result;
 }
 
-int writeBin(char *outName, long *sourceID, long *position, int *zone)
+// the IDST file of a source id is chosen by its first digit
+#define NUMIDFILES 9
+
+// stars read from a zone file at once
+#define SCANBLOCK 4096
+
+// first digit of a source id, 9 for any outcasts
+int firstDigit(long sourceID)
+{
+  while (sourceID >= 10)
+    sourceID /= 10;
+  return sourceID >= 1 ? (int)sourceID : 9;
+}
+
+int writeBin(FILE *outFile, long *sourceID, long *position, int *zone)
 {
-  FILE *outFile = fopen(outName,"ab");
   fwrite(sourceID,sizeof(long),1,outFile);
   fwrite(position,sizeof(long),1,outFile);
   fwrite(zone,sizeof(int),1,outFile);
-  fclose(outFile);
   return 0;
 }
 
+// reads the zone files in order and appends the (source id, position, zone) of each star to the IDST file
+// of its first digit. The IDST files stay open and buffered, see gaia2idnumsort.c for the numeric ID index
 int main(void)
 {
   char* catpath = "/home/jkim/work/Gaia2Bin/sortedBin/";
@@ -38,15 +52,27 @@ int main(void)
   struct dirent *dir;
   d = opendir(catpath);
 
-  long starCount1 = 0;
-  long starCount2 = 0;
-  long starCount3 = 0;
-  long starCount4 = 0;
-  long starCount5 = 0;
-  long starCount6 = 0;
-  long starCount7 = 0;
-  long starCount8 = 0;
-  long starCount9 = 0;
+  FILE *outFiles[NUMIDFILES];
+  long starCount[NUMIDFILES] = {0};
+  for (int i = 0; i < NUMIDFILES; i++)
+    {
+      char buffer[12];
+      sprintf(buffer,"%d",i+1);
+      char *outName = concat("/home/jkim/work/Gaia2Bin/IDST/id", buffer);
+      outFiles[i] = fopen(outName,"ab");
+      if (outFiles[i] == NULL)
+        {
+          printf("error: could not open file %s\n",outName);
+          exit(EXIT_FAILURE);
+        }
+      free(outName);
+    }
+  gaiastar *block = malloc(SCANBLOCK*sizeof(gaiastar));
+  if (block == NULL)
+    {
+      printf("Error: malloc failed in main\n");
+      exit(EXIT_FAILURE);
+    }
 
   if (d)
     {
@@ -61,75 +87,43 @@ int main(void)
 	  printf("%s\n",fileName);
 
 	  if (zFile == NULL)
-	    printf("error: could not open file\n");
+	    {
+	      printf("error: could not open file\n");
+	      free(fileName);
+	      continue;
+	    }
 
 	  fseek(zFile,4*1439,SEEK_SET);
 	  int numStars;//number of stars in this zone file
-	  fread((void*)(&numStars),sizeof(int),1,zFile);
+	  if (fread((void*)(&numStars),sizeof(int),1,zFile) != 1)
+	    numStars = 0;
+	  int zone = atoi(dir->d_name+1);
 
-	  for (int i = 0; i < numStars; i++)
+	  for (int i = 0; i < numStars; i += SCANBLOCK)
 	    {
-	      long position = 4*1440 + i*sizeof(gaiastar);
-	      fseek(zFile,position,SEEK_SET);
-	      long sourceID;
-	      fread((void*)(&sourceID),sizeof(long),1,zFile);
-	      char starID[20];
-	      sprintf(starID,"%ld",sourceID);
-	      char *zoneString = dir->d_name+1;
-	      int zone = atoi(zoneString);
-
-	      if (starID[0]=='1')
-		{
-		  starCount1++;
-		  writeBin("/home/jkim/work/Gaia2Bin/IDST/id1", &sourceID, &position, &zone);
-		}
-	      else if (starID[0]=='2')
-		{
-		  starCount2++;
-		  writeBin("/home/jkim/work/Gaia2Bin/IDST/id2", &sourceID, &position, &zone);
-		}
-	      else if (starID[0]=='3')
+	      int n = numStars - i < SCANBLOCK ? numStars - i : SCANBLOCK;
+	      n = fread(block,sizeof(gaiastar),n,zFile);
+	      if (n == 0)
+		break;
+	      for (int j = 0; j < n; j++)
 		{
-		  starCount3++;
-		  writeBin("/home/jkim/work/Gaia2Bin/IDST/id3", &sourceID, &position, &zone);
+		  long position = 4*1440 + (long)(i+j)*sizeof(gaiastar);
+		  long sourceID = block[j].source_id;
+		  int digit = firstDigit(sourceID);
+		  starCount[digit-1]++;
+		  writeBin(outFiles[digit-1], &sourceID, &position, &zone);
 		}
-	      else if (starID[0]=='4')
-		{
-		  starCount4++;
-		  writeBin("/home/jkim/work/Gaia2Bin/IDST/id4", &sourceID, &position, &zone);
-		}
-	      else if (starID[0]=='5')
-		{
-		  starCount5++;
-		  writeBin("/home/jkim/work/Gaia2Bin/IDST/id5", &sourceID, &position, &zone);
-		}
-	      else if (starID[0]=='6')
-		{
-		  starCount6++;
-		  writeBin("/home/jkim/work/Gaia2Bin/IDST/id6", &sourceID, &position, &zone);
-		}
-	      else if (starID[0]=='7')
-		{
-		  starCount7++;
-		  writeBin("/home/jkim/work/Gaia2Bin/IDST/id7", &sourceID, &position, &zone);
-		}
-	      else if (starID[0]=='8')
-		{
-		  starCount8++;
-		  writeBin("/home/jkim/work/Gaia2Bin/IDST/id8", &sourceID, &position, &zone);
-		}
-	      else //for 9 or any outcasts
-		{
-		  starCount9++;
-		  writeBin("/home/jkim/work/Gaia2Bin/IDST/id9", &sourceID, &position, &zone);
-		}
-
 	    }
 	  fclose(zFile);
-
-
+	  free(fileName);
 	}
+      closedir(d);
+    }
+  free(block);
+  for (int i = 0; i < NUMIDFILES; i++)
+    {
+      fclose(outFiles[i]);
+      printf("count%d: %ld\n",i+1,starCount[i]);
     }
-  printf("count1: %ld\ncount2: %ld\ncount3: %ld\ncount4: %ld\ncount5: %ld\ncount6: %ld\ncount7: %ld\ncount8: %ld\ncount9: %ld\n",starCount1,starCount2,starCount3,starCount4,starCount5,starCount6,starCount7,starCount8,starCount9);
   return 0;
 }
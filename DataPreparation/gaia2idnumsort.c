@@ -0,0 +1,343 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gaiastar.h"
+#include "gaia2idsort.h"
+#include "gaia2idindex.h"
+
+// Writes the numeric ID index (IDIndex/ids) read by gaia2read in one sequential pass over the sorted zone
+// files (sortedBin). The (source_id, position, zone) records of the stars are gathered into runs of at most
+// the memory budget (the first argument in MB, RUNMEMORY by default), each run is sorted by the value of the
+// source id and written to IDIndex, and the runs are merged into the index with a heap of the run heads.
+// Nothing depends on the number of stars of the catalog. The fence keys and the top tree of the index (see
+// gaia2idindex.h) are gathered during the merge and written after the records.
+
+#define NZONES 900
+
+// default memory budget for a run [MB]
+#define RUNMEMORY 4096
+
+// stars read from a zone file at once
+#define SCANBLOCK 4096
+
+// records read or written at once while merging
+#define MERGEBUFFER 65536
+
+// a sorted run being merged
+typedef struct
+{
+  FILE *file;
+  IDElement *buffer;
+  long size;
+  long count;
+  long next;
+} idrun;
+
+// string concatenation
+char *concat(const char *s1, const char *s2)
+{
+  char *result;
+
+  result = malloc(strlen(s1) + strlen(s2) + 1);
+  if (result == NULL)
+    {
+      printf("Error: malloc failed in concat\n");
+      exit(EXIT_FAILURE);
+    }
+  strcpy(result, s1);
+  strcat(result, s2);
+  return result;
+}
+
+// orders the records by source id, then by zone and position so duplicated ids always come out the same way
+int idnumcmp(const void * a, const void * b)
+{
+  const IDElement *r1 = a;
+  const IDElement *r2 = b;
+  if (r1->sourceID != r2->sourceID)
+    return (r1->sourceID > r2->sourceID) - (r1->sourceID < r2->sourceID);
+  if (r1->zone != r2->zone)
+    return (r1->zone > r2->zone) - (r1->zone < r2->zone);
+  return (r1->position > r2->position) - (r1->position < r2->position);
+}
+
+// sorts the records gathered so far and writes them as run number numRuns, returns the name of the run
+char *writeRun(IDElement idArray[], long count, const char *runpath, int numRuns)
+{
+  char buffer[12];
+  sprintf(buffer,"%d",numRuns+1);
+  char *runName = concat(runpath, buffer);
+
+  qsort(idArray,count,sizeof(IDElement),idnumcmp);
+
+  FILE *runFile = fopen(runName,"wb");
+  if (runFile == NULL || fwrite(idArray,sizeof(IDElement),count,runFile) != (size_t)count || fclose(runFile) != 0)
+    {
+      printf("error: could not write %s\n",runName);
+      exit(EXIT_FAILURE);
+    }
+  return runName;
+}
+
+// refills the buffer of a run, returns 0 at its end
+int fillRun(idrun *run)
+{
+  if (run->next < run->count)
+    return 1;
+  run->count = fread(run->buffer,sizeof(IDElement),run->size,run->file);
+  run->next = 0;
+  return run->count > 0;
+}
+
+// head record of a run
+#define HEAD(r) ((r)->buffer[(r)->next])
+
+// restores the min heap of runs below node k after its head changed
+void siftDown(idrun *heap[], int n, int k)
+{
+  for (;;)
+    {
+      int smallest = k;
+      int l = 2*k + 1;
+      int r = l + 1;
+      if (l < n && idnumcmp(&HEAD(heap[l]), &HEAD(heap[smallest])) < 0)
+        smallest = l;
+      if (r < n && idnumcmp(&HEAD(heap[r]), &HEAD(heap[smallest])) < 0)
+        smallest = r;
+      if (smallest == k)
+        return;
+      idrun *swap = heap[k];
+      heap[k] = heap[smallest];
+      heap[smallest] = swap;
+      k = smallest;
+    }
+}
+
+// offset rounded up to a page
+long pageAlign(long offset)
+{
+  return (offset + IDINDEX_DATAOFFSET - 1)/IDINDEX_DATAOFFSET*IDINDEX_DATAOFFSET;
+}
+
+// puts the first key of each fence page into the top tree in Eytzinger order: node k has its children at 2k
+// and 2k+1 and an in-order walk of the tree visits the pages in order. Returns the next page to place
+long eytzinger(const long fences[], long top[], long topPage[], long numTop, long page, long k)
+{
+  if (k > numTop)
+    return page;
+  page = eytzinger(fences,top,topPage,numTop,page,2*k);
+  top[k] = fences[page*IDINDEX_FENCEPAGE];
+  topPage[k] = page;
+  return eytzinger(fences,top,topPage,numTop,page+1,2*k+1);
+}
+
+int main(int argc, char *argv[])
+{
+  char* catpath = "/home/jkim/work/Gaia2Bin/sortedBin/z";
+  char* runpath = "/home/jkim/work/Gaia2Bin/IDIndex/run";
+  char* indexName = "/home/jkim/work/Gaia2Bin/IDIndex/ids";
+
+  long budget = (argc > 1 ? atol(argv[1]) : RUNMEMORY) << 20;
+  long runStars = budget/(long)sizeof(IDElement);
+  if (runStars < MERGEBUFFER)
+    runStars = MERGEBUFFER;
+
+  // PART 1: READ THE ZONE FILES INTO SORTED RUNS
+  IDElement *idArray = malloc(runStars*sizeof(IDElement));
+  gaiastar *block = malloc(SCANBLOCK*sizeof(gaiastar));
+  if (idArray == NULL || block == NULL)
+    {
+      printf("error: malloc failed for runs of %ld ids\n",runStars);
+      exit(EXIT_FAILURE);
+    }
+  char **runNames = NULL;
+  int numRuns = 0;
+  long count = 0;
+  long numStars = 0;
+  for (int z = 1; z <= NZONES; z++)
+    {
+      char buffer[12];
+      sprintf(buffer,"%d",z);
+      char *fileName = concat(catpath, buffer);
+      FILE *zFile = fopen(fileName,"rb");
+      if (zFile == NULL)
+        {
+          printf("error: could not open file %s\n",fileName);
+          exit(EXIT_FAILURE);
+        }
+
+      // the ra zone counts, the last one is the number of stars of the zone
+      int raZones[1440];
+      if (fread(raZones,sizeof(int),1440,zFile) != 1440)
+        {
+          printf("error: could not read %s\n",fileName);
+          exit(EXIT_FAILURE);
+        }
+      long position = 4*1440;
+      for (long i = 0; i < raZones[1439]; )
+        {
+          long n = raZones[1439] - i < SCANBLOCK ? raZones[1439] - i : SCANBLOCK;
+          if (fread(block,sizeof(gaiastar),n,zFile) != (size_t)n)
+            {
+              printf("error: could not read %s\n",fileName);
+              exit(EXIT_FAILURE);
+            }
+          for (long j = 0; j < n; j++)
+            {
+              if (count == runStars)
+                {
+                  runNames = realloc(runNames,(numRuns+1)*sizeof(char*));
+                  if (runNames == NULL)
+                    {
+                      printf("error: realloc failed for the run names\n");
+                      exit(EXIT_FAILURE);
+                    }
+                  runNames[numRuns] = writeRun(idArray,count,runpath,numRuns);
+                  numRuns++;
+                  count = 0;
+                }
+              IDElement *rec = &idArray[count++];
+              memset(rec,0,sizeof(IDElement));
+              rec->sourceID = block[j].source_id;
+              rec->position = position;
+              rec->zone = z;
+              position += sizeof(gaiastar);
+            }
+          i += n;
+        }
+      numStars += raZones[1439];
+      fclose(zFile);
+      free(fileName);
+    }
+  runNames = realloc(runNames,(numRuns+1)*sizeof(char*));
+  if (runNames == NULL)
+    {
+      printf("error: realloc failed for the run names\n");
+      exit(EXIT_FAILURE);
+    }
+  runNames[numRuns] = writeRun(idArray,count,runpath,numRuns);
+  numRuns++;
+  free(idArray);
+  free(block);
+  printf("%ld ids in %d runs\n",numStars,numRuns);
+
+  // PART 2: MERGE THE RUNS, ALWAYS TAKING THE SMALLEST ID AT THE HEAD OF THE RUNS
+  FILE *indexFile = fopen(indexName,"wb");
+  if (indexFile == NULL)
+    {
+      printf("error: could not open %s\n",indexName);
+      exit(EXIT_FAILURE);
+    }
+  idindexheader header;
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,IDINDEX_MAGIC,sizeof(header.magic));
+  header.version = IDINDEX_VERSION;
+  header.recordSize = sizeof(IDElement);
+  header.numStars = numStars;
+  header.blockSize = IDINDEX_BLOCK;
+  header.fencePage = IDINDEX_FENCEPAGE;
+  header.numBlocks = (numStars + IDINDEX_BLOCK - 1)/IDINDEX_BLOCK;
+  header.numTop = (header.numBlocks + IDINDEX_FENCEPAGE - 1)/IDINDEX_FENCEPAGE;
+  header.fenceOffset = pageAlign(IDINDEX_DATAOFFSET + numStars*sizeof(IDElement));
+  header.topOffset = pageAlign(header.fenceOffset + header.numBlocks*sizeof(long));
+  fwrite(&header,sizeof(header),1,indexFile);
+  fseek(indexFile,IDINDEX_DATAOFFSET,SEEK_SET);
+
+  long *fences = malloc((header.numBlocks > 0 ? header.numBlocks : 1)*sizeof(long));
+  long *top = malloc(2*(header.numTop + 1)*sizeof(long));
+  if (fences == NULL || top == NULL)
+    {
+      printf("error: malloc failed for the fences of %ld ids\n",numStars);
+      exit(EXIT_FAILURE);
+    }
+
+  // the merge buffers share the budget
+  long runBuffer = budget/(long)sizeof(IDElement)/(numRuns + 1);
+  if (runBuffer > MERGEBUFFER)
+    runBuffer = MERGEBUFFER;
+  if (runBuffer < 1024)
+    runBuffer = 1024;
+  idrun *runs = malloc(numRuns*sizeof(idrun));
+  idrun **heap = malloc(numRuns*sizeof(idrun*));
+  IDElement *out = malloc(runBuffer*sizeof(IDElement));
+  if (runs == NULL || heap == NULL || out == NULL)
+    {
+      printf("error: malloc failed for %d runs\n",numRuns);
+      exit(EXIT_FAILURE);
+    }
+  int heapSize = 0;
+  for (int i = 0; i < numRuns; i++)
+    {
+      runs[i].file = fopen(runNames[i],"rb");
+      runs[i].buffer = malloc(runBuffer*sizeof(IDElement));
+      runs[i].size = runBuffer;
+      runs[i].count = 0;
+      runs[i].next = 0;
+      if (runs[i].file == NULL || runs[i].buffer == NULL)
+        {
+          printf("error: could not open file %s\n",runNames[i]);
+          exit(EXIT_FAILURE);
+        }
+      if (fillRun(&runs[i]))
+        heap[heapSize++] = &runs[i];
+    }
+  for (int k = heapSize/2 - 1; k >= 0; k--)
+    siftDown(heap,heapSize,k);
+
+  long outCount = 0;
+  long written = 0;
+  long duplicates = 0;
+  long lastID = -1;
+  while (heapSize > 0)
+    {
+      idrun *best = heap[0];
+      duplicates += HEAD(best).sourceID == lastID;
+      lastID = HEAD(best).sourceID;
+      if ((written + outCount) % IDINDEX_BLOCK == 0)
+        fences[(written + outCount)/IDINDEX_BLOCK] = HEAD(best).sourceID;
+      out[outCount++] = HEAD(best);
+      best->next++;
+      if (!fillRun(best))
+        heap[0] = heap[--heapSize];
+      siftDown(heap,heapSize,0);
+      if (outCount == runBuffer)
+        {
+          written += fwrite(out,sizeof(IDElement),outCount,indexFile);
+          outCount = 0;
+        }
+    }
+  written += fwrite(out,sizeof(IDElement),outCount,indexFile);
+
+  // fences and top tree
+  memset(top,0,2*(header.numTop + 1)*sizeof(long));
+  eytzinger(fences,top,top + header.numTop + 1,header.numTop,0,1);
+  fseek(indexFile,header.fenceOffset,SEEK_SET);
+  fwrite(fences,sizeof(long),header.numBlocks,indexFile);
+  fseek(indexFile,header.topOffset,SEEK_SET);
+  fwrite(top,sizeof(long),2*(header.numTop + 1),indexFile);
+  free(fences);
+  free(top);
+
+  for (int i = 0; i < numRuns; i++)
+    {
+      fclose(runs[i].file);
+      remove(runNames[i]);
+      free(runNames[i]);
+      free(runs[i].buffer);
+    }
+  free(runNames);
+  free(runs);
+  free(heap);
+  free(out);
+
+  if (fclose(indexFile) != 0 || written != numStars)
+    {
+      printf("error: could not write %s\n",indexName);
+      exit(EXIT_FAILURE);
+    }
+  printf("%ld ids in %s\n",numStars,indexName);
+  if (duplicates > 0)
+    printf("warning: %ld duplicated source ids, the zone files were not written by gaia2datasort.c\n",duplicates);
+  return 0;
+}
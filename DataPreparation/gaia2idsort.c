@@ -15,7 +15,7 @@ int idcmp(const void * a, const void * b)
   return strcmp(idString1,idString2);
 }
 
-int writeBin(char *outName, IDElement idArray[], int numStars)
+int writeBin(char *outName, IDElement idArray[], long numStars)
 {
   FILE *outFile = fopen(outName,"wb");
   fwrite(idArray,sizeof(IDElement),numStars,outFile);
@@ -29,58 +29,57 @@ int main(void)
   for(int i =1; i < 10; i++)
     {
       char *fileName;
-      int numStars;
+      long numStars;
       if (i==1)
 	{
 	  fileName = "/home/jkim/work/Gaia2Bin/IDST/id1";
-	  numStars = 116724371;
 	}
       if (i==2)
 	{
 	  fileName = "/home/jkim/work/Gaia2Bin/IDST/id2";
-	  numStars = 163285128;
 	}
       if (i==3)
 	{
 	  fileName = "/home/jkim/work/Gaia2Bin/IDST/id3";
-	  numStars = 87098579;
 	}
       if (i==4)
 	{
 	  fileName = "/home/jkim/work/Gaia2Bin/IDST/id4";
-	  numStars = 585793870;
 	}
       if (i==5)
 	{
 	  fileName = "/home/jkim/work/Gaia2Bin/IDST/id5";
-	  numStars = 531853513;
 	}
       if (i==6)
 	{
 	  fileName = "/home/jkim/work/Gaia2Bin/IDST/id6";
-	  numStars = 203648450;
 	}
       if (i==7)
 	{
 	  fileName = "/home/jkim/work/Gaia2Bin/IDST/id7";
-	  numStars = 1990817;
 	}
       if (i==8)
 	{
 	  fileName = "/home/jkim/work/Gaia2Bin/IDST/id8";
-	  numStars = 3698075;
 	}
       if (i==9)
 	{
 	  fileName = "/home/jkim/work/Gaia2Bin/IDST/id9";
-	  numStars = 6507262;
 	}
 
-      // create and sort the IDElement array from the file
-      IDElement *idArray = malloc(numStars*sizeof(IDElement));
+      // create and sort the IDElement array from the file, gaia2idBin writes 20 bytes per star
       FILE *idFile = fopen(fileName,"rb");
       printf("%s\n",fileName);
-      for (int j = 0; j < numStars; j++)
+      if (idFile == NULL)
+	{
+	  printf("error: could not open file %s\n",fileName);
+	  exit(EXIT_FAILURE);
+	}
+      fseek(idFile,0,SEEK_END);
+      numStars = ftell(idFile)/(2*sizeof(long) + sizeof(int));
+      fseek(idFile,0,SEEK_SET);
+      IDElement *idArray = malloc((numStars > 0 ? numStars : 1)*sizeof(IDElement));
+      for (long j = 0; j < numStars; j++)
 	{
 	  long id;
 	  long pos;
@@ -1,3 +1,6 @@
+#ifndef GAIA2_IDSORT_H__
+#define GAIA2_IDSORT_H__
+
 typedef struct
 {
   long sourceID;
@@ -5,3 +8,5 @@ typedef struct
   int zone;
 
 }IDElement;
+
+#endif
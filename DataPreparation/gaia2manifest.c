@@ -0,0 +1,154 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "gaiastar.h"
+#include "gaia2zone.h"
+#include "gaia2catalog.h"
+
+// Writes the manifest of a catalog (see gaia2catalog.h) after the other tools have built it: the zone geometry,
+// the record size, the layouts and ID files found in the catalog directory and the number of stars of each
+// sorted zone file. The arguments are the catalog directory, the release and the epoch of the positions, by
+// default GAIA2_CATPATH, DR2 and 2015.5.
+
+// local functions
+char *concat(const char *s1, const char *s2);
+bool exists(const char *dir, const char *name);
+long countStars(const char *fileName);
+
+// main method
+int main(int argc, char** argv)
+{
+  const char *dir = argc > 1 ? argv[1] : GAIA2_CATPATH;
+  const char *release = argc > 2 ? argv[2] : "DR2";
+  double refepoch = argc > 3 ? atof(argv[3]) : GAIA2_REFEPOCH;
+
+  char *prefix = concat(dir, "/");
+  char *binpath = concat(prefix, "sortedBin/z");
+  long *zoneStars = malloc((GAIA2_NZONES+1)*sizeof(long));
+  if (zoneStars == NULL)
+    {
+      printf("error: malloc failed\n");
+      exit(EXIT_FAILURE);
+    }
+
+  // the counts are read before the manifest is written, so a catalog that is not complete keeps its old one
+  long numStars = 0;
+  for (int z = 1; z <= GAIA2_NZONES; z++)
+    {
+      char buffer[12];
+      sprintf(buffer,"%d",z);
+      char *fileName = concat(binpath, buffer);
+      zoneStars[z] = countStars(fileName);
+      if (zoneStars[z] < 0)
+        exit(EXIT_FAILURE);
+      numStars += zoneStars[z];
+      free(fileName);
+    }
+
+  char *manifestName = concat(prefix, GAIA2_MANIFEST);
+  FILE *manifest = fopen(manifestName,"w");
+  if (manifest == NULL)
+    {
+      printf("error: could not open file %s\n",manifestName);
+      exit(EXIT_FAILURE);
+    }
+
+  fprintf(manifest,"# catalog manifest written by gaia2manifest, %ld stars\n",numStars);
+  fprintf(manifest,"version %d\n",GAIA2_CATVERSION);
+  fprintf(manifest,"release %s\n",release);
+  fprintf(manifest,"refepoch %.1f\n",refepoch);
+  fprintf(manifest,"zones %d 0.2\n",GAIA2_NZONES);
+  fprintf(manifest,"razones %d\n",GAIA2_NRAZONES);
+  fprintf(manifest,"recordsize %d\n",(int)sizeof(gaiastar));
+  fprintf(manifest,"layout rows sortedBin/z\n");
+  if (exists(dir, "sortedCol/z1"))
+    fprintf(manifest,"layout columns sortedCol/z\n");
+  if (exists(dir, "sortedAst/z1") && exists(dir, "sortedPhot/z1"))
+    fprintf(manifest,"layout split sortedAst/z sortedPhot/z\n");
+  if (exists(dir, "IDIndex/ids"))
+    fprintf(manifest,"idindex IDIndex/ids\n");
+  if (exists(dir, "IDSTSort/id1"))
+    fprintf(manifest,"idsort IDSTSort/id\n");
+  // the cross-ID files are kept next to the catalog
+  if (exists(dir, "../Gaia2Mass/IDgaiaSort"))
+    fprintf(manifest,"crossid gaia ../Gaia2Mass/IDgaiaSort\n");
+  if (exists(dir, "../Gaia2Mass/IDtmassSort"))
+    fprintf(manifest,"crossid tmass ../Gaia2Mass/IDtmassSort\n");
+  if (exists(dir, "../Gaia2Mass/IDhatSort"))
+    fprintf(manifest,"crossid hat ../Gaia2Mass/IDhatSort\n");
+  if (exists(dir, "../Gaia2Mass/IDcross"))
+    fprintf(manifest,"crossidstore ../Gaia2Mass/IDcross\n");
+  for (int z = 1; z <= GAIA2_NZONES; z++)
+    fprintf(manifest,"zone %d %ld\n",z,zoneStars[z]);
+
+  if (fclose(manifest) != 0)
+    {
+      printf("error: could not write file %s\n",manifestName);
+      exit(EXIT_FAILURE);
+    }
+  printf("%s: %ld stars\n",manifestName,numStars);
+
+  free(manifestName);
+  free(zoneStars);
+  free(binpath);
+  free(prefix);
+  return 0;
+}
+
+// string concatenation
+char *concat(const char *s1, const char *s2)
+{
+  char *result;
+
+  result = malloc(strlen(s1) + strlen(s2) + 1);
+  if (result == NULL)
+    {
+      printf("Error: malloc failed in concat\n");
+      exit(EXIT_FAILURE);
+    }
+  strcpy(result, s1);
+  strcat(result, s2);
+  return result;
+}
+
+// whether a file of the catalog directory can be read
+bool exists(const char *dir, const char *name)
+{
+  char *prefix = concat(dir, "/");
+  char *fileName = concat(prefix, name);
+  FILE *file = fopen(fileName,"rb");
+  free(prefix);
+  free(fileName);
+  if (file == NULL)
+    return false;
+  fclose(file);
+  return true;
+}
+
+// number of stars of a sorted zone file, checked against the last count of its ra zone header. Returns -1 if
+// the file cannot be read or is not a sorted zone file
+long countStars(const char *fileName)
+{
+  FILE *binFile = fopen(fileName,"rb");
+  if (binFile == NULL)
+    {
+      printf("error: could not open file %s\n",fileName);
+      return -1;
+    }
+
+  int raZones[GAIA2_NRAZONES];
+  bool valid = fread(raZones,sizeof(int),GAIA2_NRAZONES,binFile) == GAIA2_NRAZONES;
+  fseek(binFile,0,SEEK_END);
+  long size = ftell(binFile) - GAIA2_NRAZONES*sizeof(int);
+  fclose(binFile);
+
+  long numStars = size/(long)sizeof(gaiastar);
+  if (!valid || size % sizeof(gaiastar) != 0 || raZones[GAIA2_NRAZONES-1] != numStars)
+    {
+      printf("error: %s is not a sorted zone file\n",fileName);
+      return -1;
+    }
+  return numStars;
+}
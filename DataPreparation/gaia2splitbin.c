@@ -0,0 +1,106 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "gaiastar.h"
+#include "gaia2zone.h"
+
+// Rewrites the sorted zone files (sortedBin/z1 ... z900, see gaia2datasort.c) in the split layout read by
+// gaia2read --layout split: sortedAst/z holds the ra zone counts and the astrometric block of the stars
+// (gaiastar_ast), sortedPhot/z the photometry block (gaiastar_phot) of the same stars in the same order.
+
+// local functions
+char *concat(const char *s1, const char *s2);
+int writeSplitBin(FILE* binFile, char* astName, char* photName);
+
+// main method
+int main(void)
+{
+  char* catpath = "/home/jkim/work/Gaia2Bin/sortedBin/z";
+  char* astpath = "/home/jkim/work/Gaia2Bin/sortedAst/z";
+  char* photpath = "/home/jkim/work/Gaia2Bin/sortedPhot/z";
+
+  for(int z = 1; z < 901; z++)
+    {
+      char buffer[12];
+      sprintf(buffer,"%d",z);
+      char *fileName = concat(catpath, buffer);
+      char *astName = concat(astpath, buffer);
+      char *photName = concat(photpath, buffer);
+
+      printf("%s\n",astName);
+      FILE *binFile = fopen(fileName,"rb");
+      if ( binFile == NULL )
+        {
+          printf("error: could not open file %s\n",fileName);
+          exit(EXIT_FAILURE);
+        }
+      if (writeSplitBin(binFile,astName,photName) != 0)
+        exit(EXIT_FAILURE);
+
+      fclose(binFile);
+      free(fileName);
+      free(astName);
+      free(photName);
+    }
+
+  return 0;
+}
+
+// string concatenation
+char *concat(const char *s1, const char *s2)
+{
+  char *result;
+
+  result = malloc(strlen(s1) + strlen(s2) + 1);
+  if (result == NULL)
+    {
+      printf("Error: malloc failed in concat\n");
+      exit(EXIT_FAILURE);
+    }
+  strcpy(result, s1);
+  strcat(result, s2);
+  return result;
+}
+
+// reads a sortedBin zone file star by star and writes its two blocks
+int writeSplitBin(FILE* binFile, char* astName, char* photName)
+{
+  int raZones[GAIA2_NRAZONES];
+  if (fread(raZones,sizeof(int),GAIA2_NRAZONES,binFile) != GAIA2_NRAZONES)
+    {
+      printf("error: missing ra zones in %s\n",astName);
+      return 1;
+    }
+
+  FILE *astFile = fopen(astName,"wb");
+  FILE *photFile = fopen(photName,"wb");
+  if (astFile == NULL || photFile == NULL)
+    {
+      printf("error: could not open %s or %s\n",astName,photName);
+      return 1;
+    }
+  fwrite(raZones,sizeof(int),GAIA2_NRAZONES,astFile);
+
+  gaiastar st;
+  while (fread(&st,sizeof(gaiastar),1,binFile) == 1)
+    {
+      gaiastar_ast ast;
+      gaiastar_phot phot;
+      memset(&ast,0,sizeof(ast));
+      memset(&phot,0,sizeof(phot));
+
+      for (int f = 0; f < GAIASTAR_NFIELDS; f++)
+        {
+          char *block = f < GAIASTAR_NASTROMETRIC ? (char*)&ast : (char*)&phot;
+          memcpy(block + gaiastar_fields[f].splitoffset,(char*)&st + gaiastar_fields[f].offset,gaiastar_fields[f].size);
+        }
+      fwrite(&ast,sizeof(ast),1,astFile);
+      fwrite(&phot,sizeof(phot),1,photFile);
+    }
+
+  int err = fclose(astFile) != 0;
+  err |= fclose(photFile) != 0;
+  return err;
+}
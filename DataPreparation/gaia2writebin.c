@@ -1,28 +1,174 @@
+#define _POSIX_C_SOURCE 200809L
 #include <string.h>
 #include <dirent.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <zlib.h>
+
+// PARALLEL INGEST:
+// The GaiaSource_*.csv.gz files are shared out to worker threads (the number of threads is the first argument,
+// all cpus by default). Each worker keeps a buffer of ZONEBUFFER records for every zone it has seen and appends
+// a full buffer to the zone file in one write, holding the lock of that zone so the appends of the workers do
+// not interleave. The order of the stars within a zone file does not matter, gaia2datasort.c sorts them.
+//
+// CHECKPOINTS:
+// When a worker has read a file it writes out all of its buffers and adds the name of the file to the
+// checkpoint file next to the zone files. Just before, the zone files that grew since the last checkpoint are
+// synced to disk and the lengths of all zone files are saved in checkpoint.zones, which is replaced in one
+// rename, so the saved lengths never exceed what survives a power loss. A build that was interrupted is resumed by running the
+// program again: the zone files are cut back to the saved lengths, which drops a record cut off by the
+// interruption and the stars of the files that were never checkpointed, and the files named in the
+// checkpoint file are skipped. The stars of the files that were being read when the lengths were saved may
+// still be partly in the zone files and are written again, gaia2datasort.c removes these duplicates. A new
+// build starts with an empty binFiles2 folder.
+//
+// PARSING:
+// The files are decompressed in the worker with zlib and read in blocks of READBLOCK bytes. The rows are split
+// in place, a columnmap built from the header of the file gives the value index of each column (or -1 for the
+// skipped ones) and the numbers go through parseNumber, which is exact and needs no copy for up to 19 digits
+// and falls back to strtod otherwise.
+//
+// SCHEMA:
+// The columns are found by name in the header row, so any release with a header can be read: DR2 csv files
+// as well as the EDR3/DR3 ones, whose ECSV metadata lines (starting with #) are skipped. By default the values
+// are read from the columns named as in DR2 (valueNames). The schema file given as the second argument renames
+// them for other releases, one "<value> <column>" pair per line, "<value> -" for a value the release does not
+// have, and "epoch <year>" for the ref_epoch of files without that column (see schema_dr3.txt).
+
+#define NZONES 900
+
+// a zone file record: the source id and 48 values
+#define RECORDSIZE (sizeof(unsigned long long) + 48*sizeof(double))
+
+// records buffered per zone and worker
+#define ZONEBUFFER 256
+
+// values of a record, the dec is value 3
+#define NVALUES 48
+
+// bytes decompressed at once
+#define READBLOCK (1 << 20)
+
+// codes of the values that are not numbers, read by gaia2datasort.c and gaia2read
+#define CODE_EMPTY 3.55
+#define CODE_NOT_AVAILABLE 4.55
+#define CODE_VARIABLE 5.55
+#define CODE_FALSE 6.55
+#define CODE_TRUE 7.55
+
+// the values of a record in the order of the gaiastar fields after source_id (see gaia2datasort.c), named
+// as the DR2 columns
+static const char *valueNames[NVALUES] = {
+  "ref_epoch", "ra", "ra_error", "dec", "dec_error", "parallax", "parallax_error", "pmra", "pmra_error", "pmdec",
+  "pmdec_error", "astrometric_excess_noise", "astrometric_excess_noise_sig", "astrometric_primary_flag",
+  "phot_g_n_obs", "phot_g_mean_flux", "phot_g_mean_flux_error", "phot_g_mean_flux_over_error", "phot_g_mean_mag",
+  "phot_bp_n_obs", "phot_bp_mean_flux", "phot_bp_mean_flux_error", "phot_bp_mean_flux_over_error",
+  "phot_bp_mean_mag", "phot_rp_n_obs", "phot_rp_mean_flux", "phot_rp_mean_flux_error",
+  "phot_rp_mean_flux_over_error", "phot_rp_mean_mag", "phot_bp_rp_excess_factor", "radial_velocity",
+  "radial_velocity_error", "phot_variable_flag", "teff_val", "teff_percentile_lower", "teff_percentile_upper",
+  "a_g_val", "a_g_percentile_lower", "a_g_percentile_upper", "e_bp_min_rp_val", "e_bp_min_rp_percentile_lower",
+  "e_bp_min_rp_percentile_upper", "radius_val", "radius_percentile_lower", "radius_percentile_upper", "lum_val",
+  "lum_percentile_lower", "lum_percentile_upper"
+};
+
+// column of each value as set by the schema, NULL if the release does not have the value
+static char *valueColumns[NVALUES];
+
+// ref_epoch of the stars of files without a ref_epoch column
+static double defaultEpoch = 2015.5;
+
+// the columns of a file
+typedef struct
+{
+  int numColumns;
+  int *field;           // value index of each column, -1 for the skipped ones
+  int sourceColumn;     // column of the source_id
+} columnmap;
+
+// the files to ingest and the locks of the zone files, shared by the workers
+typedef struct
+{
+  char **files;
+  int numFiles;
+  int next;                        // next file to hand out
+  pthread_mutex_t lock;            // for next and checkpoint
+  pthread_mutex_t zoneLocks[NZONES];
+  long zoneBytes[NZONES];          // length of each zone file, under the lock of the zone
+  long zoneSynced[NZONES];         // length of each zone file on the disk, under the lock of the zone
+  FILE *checkpoint;                // names of the files that are completely in the zone files
+  const char *zonesName;           // lengths of the zone files at the last checkpoint
+} ingest;
+
+// records of one zone waiting to be written
+typedef struct
+{
+  char *data;
+  int count;
+} zonebuffer;
+
+typedef struct
+{
+  ingest *in;
+  zonebuffer zones[NZONES];
+} worker;
 
 //local functions
 // string concatenation
 char *concat(const char *s1, const char *s2);
-bool checkCount(int count94);
-double starASCIIrd(char *str);
-int writeBin(double dec, double starArray[], unsigned long long *sourceID);
-int *readFile(FILE* catfile);
-FILE *popen(const char *command, const char *mode);
-char * strsep(char **stringp, const char *delim);
+void readSchema(const char *schemaName);
+int mapColumns(char *line, char *end, columnmap *map, const char *fileName);
+double parseNumber(const char *p, const char *end);
+double parseValue(const char *p, const char *end);
+void parseRow(char *line, char *end, const columnmap *map, worker *w);
+int bufferStar(worker *w, double dec, double starArray[], unsigned long long *sourceID);
+int flushZone(worker *w, int zone);
+int namecmp(const void *a, const void *b);
+char **readCheckpoint(const char *checkpointName, int *numDone);
+char *zoneFileName(int zone);
+void restoreZones(const char *zonesName, long zoneBytes[]);
+void saveZones(ingest *in);
+int readFile(gzFile catfile, worker *w, const char *fileName);
+void *ingestFiles(void *arg);
 
 // main method
-int main(void)
+int main(int argc, char *argv[])
 {
-   bool already = true;
-
   // PART 1: OBTAIN DATA AND PUT STARS INTO ZONE FILES
   char* catpath = "/home/jkim/catalogs/GaiaDR2/";
-  const char prefix[] = "zcat ";
-  char* cmd;
+  int numThreads = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (numThreads < 1)
+    numThreads = 1;
+  for (int v = 0; v < NVALUES; v++)
+    valueColumns[v] = (char*)valueNames[v];
+  if (argc > 2)
+    readSchema(argv[2]);
+
+  char* checkpointName = "/home/jkim/work/Gaia2Bin/binFiles2/checkpoint";
+  int numDone;
+  char **done = readCheckpoint(checkpointName, &numDone);
+
+  ingest in;
+  in.files = NULL;
+  in.numFiles = 0;
+  in.next = 0;
+  in.zonesName = "/home/jkim/work/Gaia2Bin/binFiles2/checkpoint.zones";
+  restoreZones(in.zonesName, in.zoneBytes);
+  memcpy(in.zoneSynced, in.zoneBytes, sizeof(in.zoneBytes));
+  in.checkpoint = fopen(checkpointName, "a");
+  if (in.checkpoint == NULL)
+    {
+      printf("error: could not open %s\n", checkpointName);
+      exit(EXIT_FAILURE);
+    }
+  pthread_mutex_init(&in.lock, NULL);
+  for (int z = 0; z < NZONES; z++)
+    pthread_mutex_init(&in.zoneLocks[z], NULL);
+
   DIR *d;
   struct dirent *dir;
   d = opendir(catpath);
@@ -32,29 +178,47 @@ int main(void)
         {
           if ((dir->d_name)[0]!='G')
             continue;
-          //printf("%s\n", dir->d_name);                                                                                                                                                                    
           char *fileName = concat(catpath, dir->d_name);
-	  
-	  //if (!strcmp(fileName, "/home/jkim/catalogs/GaiaDR2/GaiaSource_5879405436152890368_5879427980482735104.csv.gz"))
-	     already = false;
-      	  if (already)
-	    continue;
-          cmd = malloc(sizeof(prefix) + strlen(fileName) + 1);
-          sprintf(cmd, "%s%s", prefix, fileName);
-
-          FILE *catfile = popen(cmd,"r");
-          printf("%s\n", fileName);
-
-          if ( catfile == NULL )
+          if (numDone > 0 && bsearch(&fileName, done, numDone, sizeof(char*), namecmp) != NULL)
             {
-              printf("error: could not open file\n");
+              free(fileName);
+              continue;
             }
-	  readFile(catfile);
-          fclose(catfile);
-	  
+          in.files = realloc(in.files, (in.numFiles+1)*sizeof(char*));
+          if (in.files == NULL)
+            {
+              printf("Error: realloc failed for the file list\n");
+              exit(EXIT_FAILURE);
+            }
+          in.files[in.numFiles++] = fileName;
         }
       closedir(d);
     }
+  if (numDone > 0)
+    printf("resuming: %d files were already read\n", numDone);
+  for (int k = 0; k < numDone; k++)
+    free(done[k]);
+  free(done);
+
+  pthread_t *threads = malloc(numThreads*sizeof(pthread_t));
+  worker *workers = calloc(numThreads, sizeof(worker));
+  if (threads == NULL || workers == NULL)
+    {
+      printf("Error: malloc failed for %d workers\n", numThreads);
+      exit(EXIT_FAILURE);
+    }
+  for (int t = 0; t < numThreads; t++)
+    {
+      workers[t].in = &in;
+      if (pthread_create(&threads[t], NULL, ingestFiles, &workers[t]) != 0)
+        {
+          printf("error: could not start worker %d\n", t);
+          exit(EXIT_FAILURE);
+        }
+    }
+  for (int t = 0; t < numThreads; t++)
+    pthread_join(threads[t], NULL);
+  fclose(in.checkpoint);
 
   // PART 2: INSPECT EACH ZONE FILE AND SORT STARS BASED ON RA
 
@@ -63,6 +227,182 @@ int main(void)
   return 0;
 }
 
+// worker thread: takes the files one by one and flushes its zone buffers when there are no more
+void *ingestFiles(void *arg)
+{
+  worker *w = arg;
+  ingest *in = w->in;
+  for (;;)
+    {
+      pthread_mutex_lock(&in->lock);
+      int f = in->next < in->numFiles ? in->next++ : -1;
+      pthread_mutex_unlock(&in->lock);
+      if (f < 0)
+        break;
+
+      char *fileName = in->files[f];
+      gzFile catfile = gzopen(fileName,"rb");
+      printf("%s\n", fileName);
+
+      if ( catfile == NULL )
+        {
+          printf("error: could not open file\n");
+          continue;
+        }
+      gzbuffer(catfile, READBLOCK);
+      int err = readFile(catfile, w, fileName);
+      gzclose(catfile);
+
+      // all stars of the file are written before it goes into the checkpoint
+      for (int z = 0; z < NZONES; z++)
+        flushZone(w, z);
+      if (err != 0)
+        {
+          printf("error: could not decompress %s\n", fileName);
+          continue;
+        }
+      pthread_mutex_lock(&in->lock);
+      saveZones(in);
+      fprintf(in->checkpoint, "%s\n", fileName);
+      fflush(in->checkpoint);
+      pthread_mutex_unlock(&in->lock);
+    }
+
+  for (int z = 0; z < NZONES; z++)
+    free(w->zones[z].data);
+  return NULL;
+}
+
+int namecmp(const void *a, const void *b)
+{
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// reads the names of the files of an earlier run that are already in the zone files
+char **readCheckpoint(const char *checkpointName, int *numDone)
+{
+  char **done = NULL;
+  *numDone = 0;
+  FILE *checkpoint = fopen(checkpointName, "r");
+  if (checkpoint == NULL)
+    return NULL;
+
+  char line[4096];
+  while (fgets(line, sizeof(line), checkpoint) != NULL)
+    {
+      size_t length = strlen(line);
+      if (length == 0 || line[length-1] != '\n')   // cut off by the interruption
+        continue;
+      line[length-1] = '\0';
+      done = realloc(done, (*numDone+1)*sizeof(char*));
+      if (done == NULL)
+        {
+          printf("Error: realloc failed for the checkpoint\n");
+          exit(EXIT_FAILURE);
+        }
+      done[(*numDone)++] = concat(line, "");
+    }
+  fclose(checkpoint);
+  qsort(done, *numDone, sizeof(char*), namecmp);
+  return done;
+}
+
+// name of the zone file of a zone (0 ... 899)
+char *zoneFileName(int zone)
+{
+  char zString [12];
+  sprintf(zString,"%d",zone+1);
+  return concat("/home/jkim/work/Gaia2Bin/binFiles2/z", zString);
+}
+
+// cuts the zone files back to the lengths saved with the last checkpoint, or without saved lengths to whole
+// records, and sets zoneBytes to their lengths
+void restoreZones(const char *zonesName, long zoneBytes[])
+{
+  long saved[NZONES];
+  bool haveSaved = false;
+  FILE *zones = fopen(zonesName, "r");
+  if (zones != NULL)
+    {
+      haveSaved = true;
+      for (int z = 0; z < NZONES; z++)
+        if (fscanf(zones, "%ld", &saved[z]) != 1 || saved[z] < 0 || saved[z] % RECORDSIZE != 0)
+          {
+            printf("error: %s is not a list of %d zone file lengths\n", zonesName, NZONES);
+            exit(EXIT_FAILURE);
+          }
+      fclose(zones);
+    }
+
+  for (int z = 0; z < NZONES; z++)
+    {
+      char *outName = zoneFileName(z);
+      struct stat st;
+      long size = stat(outName, &st) == 0 ? (long)st.st_size : 0;
+      long length = haveSaved ? saved[z] : size - size % (long)RECORDSIZE;
+      if (size < length)
+        {
+          printf("error: %s has %ld bytes, the checkpoint has %ld\n", outName, size, length);
+          exit(EXIT_FAILURE);
+        }
+      if (size > length)
+        {
+          if (truncate(outName, length) != 0)
+            {
+              printf("error: could not truncate %s\n", outName);
+              exit(EXIT_FAILURE);
+            }
+          printf("%s: dropped %ld bytes written after the checkpoint\n", outName, size - length);
+        }
+      zoneBytes[z] = length;
+      free(outName);
+    }
+}
+
+// saves the lengths of the zone files, called with the checkpoint lock held before a file is checkpointed.
+// The zone files that grew are synced first. The lengths are written to a new file that replaces the old one,
+// so an interruption leaves either of them
+void saveZones(ingest *in)
+{
+  long lengths[NZONES];
+  for (int z = 0; z < NZONES; z++)
+    {
+      pthread_mutex_lock(&in->zoneLocks[z]);
+      if (in->zoneBytes[z] != in->zoneSynced[z])
+        {
+          char *outName = zoneFileName(z);
+          int fd = open(outName, O_WRONLY);
+          if (fd < 0 || fsync(fd) != 0)
+            {
+              printf("error: could not sync %s\n", outName);
+              exit(EXIT_FAILURE);
+            }
+          close(fd);
+          free(outName);
+          in->zoneSynced[z] = in->zoneBytes[z];
+        }
+      lengths[z] = in->zoneBytes[z];
+      pthread_mutex_unlock(&in->zoneLocks[z]);
+    }
+
+  char *tmpName = concat(in->zonesName, ".tmp");
+  FILE *zones = fopen(tmpName, "w");
+  int err = zones == NULL;
+  for (int z = 0; z < NZONES && !err; z++)
+    err = fprintf(zones, "%ld\n", lengths[z]) < 0;
+  if (zones != NULL)
+    {
+      err |= fflush(zones) != 0 || fsync(fileno(zones)) != 0;
+      err |= fclose(zones) != 0;
+    }
+  if (err || rename(tmpName, in->zonesName) != 0)
+    {
+      printf("error: could not write %s\n", in->zonesName);
+      exit(EXIT_FAILURE);
+    }
+  free(tmpName);
+}
+
 // string concatenation
 char *concat(const char *s1, const char *s2)
 {
@@ -79,92 +419,312 @@ char *concat(const char *s1, const char *s2)
   return result;
 }
 
-bool checkCount(int count94)
+// reads the column names of a release from a schema file
+void readSchema(const char *schemaName)
 {
-  int badNums[46]={0,1,2,3,11,16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31,34,36,37,38,39,40,41,42,43,44,45,62,63,64,65,68,69,70,71,73,74,75,76,77,87};
-  for (int i = 0; i < 46; i++)
+  FILE *schema = fopen(schemaName,"r");
+  if (schema == NULL)
     {
-      if (count94==badNums[i])
-	return false;
+      printf("error: could not open schema %s\n",schemaName);
+      exit(EXIT_FAILURE);
     }
-  return true;
+  char line[256];
+  int lineNumber = 0;
+  while (fgets(line,sizeof(line),schema) != NULL)
+    {
+      lineNumber++;
+      char name[128], column[128];
+      if (line[0] == '#' || sscanf(line,"%127s %127s",name,column) != 2)
+        continue;
+
+      if (strcmp(name,"epoch") == 0)
+        {
+          defaultEpoch = atof(column);
+          continue;
+        }
+      int v = 0;
+      while (v < NVALUES && strcmp(valueNames[v],name) != 0)
+        v++;
+      if (v == NVALUES)
+        {
+          printf("error: unknown value %s in line %d of %s\n",name,lineNumber,schemaName);
+          exit(EXIT_FAILURE);
+        }
+      valueColumns[v] = strcmp(column,"-") == 0 ? NULL : concat(column,"");
+    }
+  fclose(schema);
 }
 
-double starASCIIrd(char *str)
+// finds the columns of the values in the header row of a file. Returns non-zero if there is no source_id
+int mapColumns(char *line, char *end, columnmap *map, const char *fileName)
 {
-  char *token;
-  if (str[strlen(str)-1]=='\n')
+  map->numColumns = 1;
+  for (char *p = line; p < end; p++)
+    map->numColumns += *p == ',';
+  map->field = malloc(map->numColumns*sizeof(int));
+  if (map->field == NULL)
+    {
+      printf("Error: malloc failed in mapColumns\n");
+      exit(EXIT_FAILURE);
+    }
+  map->sourceColumn = -1;
+
+  bool found[NVALUES] = {false};
+  char *p = line;
+  for (int c = 0; c < map->numColumns; c++)
+    {
+      char *comma = memchr(p, ',', end - p);
+      char *nameEnd = comma != NULL ? comma : end;
+      size_t length = nameEnd - p;
+      map->field[c] = -1;
+      if (length == 9 && memcmp(p, "source_id", 9) == 0)
+        map->sourceColumn = c;
+      for (int v = 0; v < NVALUES; v++)
+        if (valueColumns[v] != NULL && strlen(valueColumns[v]) == length && memcmp(p, valueColumns[v], length) == 0)
+          {
+            map->field[c] = v;
+            found[v] = true;
+          }
+      p = nameEnd + 1;
+    }
+
+  for (int v = 0; v < NVALUES; v++)
+    if (!found[v] && valueColumns[v] != NULL && v != 0)
+      printf("warning: no column %s in %s\n",valueColumns[v],fileName);
+  return map->sourceColumn < 0;
+}
+
+// powers of ten that are exact doubles
+static const double exactPowers[23] = {1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,1e12,1e13,1e14,1e15,1e16,
+                                       1e17,1e18,1e19,1e20,1e21,1e22};
+
+// parses a decimal number. If the digits fit into 2^53 and the power of ten is at most 22, both are exact
+// doubles and one multiplication or division rounds correctly, as strtod does (Clinger's fast path)
+double parseNumber(const char *p, const char *end)
+{
+  const char *start = p;
+  bool negative = *p == '-';
+  if (*p == '-' || *p == '+')
+    p++;
+
+  unsigned long long mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool point = false;
+  for (; p < end; p++)
+    {
+      if (*p >= '0' && *p <= '9')
+        {
+          if (mantissa != 0 || *p != '0')
+            digits++;
+          mantissa = mantissa*10 + (*p - '0');
+          if (point)
+            exponent--;
+          if (digits > 19)
+            break;
+        }
+      else if (*p == '.' && !point)
+        point = true;
+      else
+        break;
+    }
+  if (p < end && (*p == 'e' || *p == 'E') && digits <= 19)
+    {
+      const char *e = p+1;
+      bool eNegative = e < end && *e == '-';
+      if (e < end && (*e == '-' || *e == '+'))
+        e++;
+      int value = 0;
+      for (; e < end && *e >= '0' && *e <= '9' && value < 10000; e++)
+        value = value*10 + (*e - '0');
+      exponent += eNegative ? -value : value;
+      p = e;
+    }
+
+  if (p == end && digits <= 19 && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22)
     {
-      token = (char*) malloc(strlen(str));
-      strncpy(token,str,strlen(str)-1);
-	}
-  else
-    token = str;
-  if (strcmp(token, "")==0)
-    return 3.55;
-  if (strcmp(token, "NOT_AVAILABLE")==0)
-    return 4.55;
-  if (strcmp(token, "VARIABLE")==0)
-    return 5.55;
-  if (strcmp(token, "false")==0)
-    return 6.55;
-  if (strcmp(token, "true")==0)
-    return 7.55;                                                                                                                                                                                        
-  return atof(token);
+      double value = (double)mantissa;
+      value = exponent < 0 ? value/exactPowers[-exponent] : value*exactPowers[exponent];
+      return negative ? -value : value;
+    }
+
+  // long or unusual numbers
+  char number[64];
+  size_t length = end - start < 63 ? (size_t)(end - start) : 63;
+  memcpy(number, start, length);
+  number[length] = '\0';
+  return strtod(number, NULL);
+}
+
+// value of a field: the number or the code of an empty field or a flag. The ECSV files of the later releases
+// write null, True and False
+double parseValue(const char *p, const char *end)
+{
+  size_t length = end - p;
+  if (length == 0)
+    return CODE_EMPTY;
+  if ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.')
+    return parseNumber(p, end);
+  if (length == 4 && memcmp(p, "null", 4) == 0)
+    return CODE_EMPTY;
+  if (length == 13 && memcmp(p, "NOT_AVAILABLE", 13) == 0)
+    return CODE_NOT_AVAILABLE;
+  if (length == 8 && memcmp(p, "VARIABLE", 8) == 0)
+    return CODE_VARIABLE;
+  if (length == 5 && (memcmp(p, "false", 5) == 0 || memcmp(p, "False", 5) == 0))
+    return CODE_FALSE;
+  if (length == 4 && (memcmp(p, "true", 4) == 0 || memcmp(p, "True", 4) == 0))
+    return CODE_TRUE;
+  return parseNumber(p, end);
 }
 
-int writeBin(double dec, double starArray[], unsigned long long *sourceID)
+// adds a star to the buffer of its zone, writing the buffer out when it is full
+int bufferStar(worker *w, double dec, double starArray[], unsigned long long *sourceID)
 {
   double dPos = dec + 90.0;
   int zone = (int)((dPos/0.2) + 1);
   if (dPos == 180.0)
     zone = 900;
-  char zString [4];
-  sprintf(zString,"%d",zone);
-  char* outName = concat("/home/jkim/work/Gaia2Bin/binFiles2/z", zString);
+  zonebuffer *zb = &w->zones[zone-1];
+  if (zb->data == NULL)
+    {
+      zb->data = malloc(ZONEBUFFER*RECORDSIZE);
+      if (zb->data == NULL)
+        {
+          printf("Error: malloc failed for the buffer of zone %d\n", zone);
+          exit(EXIT_FAILURE);
+        }
+    }
+  char *record = zb->data + zb->count*RECORDSIZE;
+  memcpy(record, sourceID, sizeof(*sourceID));
+  memcpy(record + sizeof(*sourceID), starArray, 48*sizeof(starArray[0]));
+  if (++zb->count == ZONEBUFFER)
+    return flushZone(w, zone-1);
+  return 0;
+}
+
+// appends the buffered records of a zone (0 ... 899) to its zone file
+int flushZone(worker *w, int zone)
+{
+  zonebuffer *zb = &w->zones[zone];
+  if (zb->count == 0)
+    return 0;
+
+  char* outName = zoneFileName(zone);
+  pthread_mutex_lock(&w->in->zoneLocks[zone]);
   FILE *outFile = fopen(outName,"ab");
-  fwrite(sourceID,sizeof(sourceID),1,outFile);
-  fwrite(starArray,sizeof(starArray[0]),48,outFile);
-  fclose(outFile);
+  int err = outFile == NULL || fwrite(zb->data,RECORDSIZE,zb->count,outFile) != (size_t)zb->count;
+  if (outFile != NULL)
+    err |= fclose(outFile) != 0;
+  if (!err)
+    w->in->zoneBytes[zone] += zb->count*RECORDSIZE;
+  pthread_mutex_unlock(&w->in->zoneLocks[zone]);
+  if (err)
+    {
+      printf("error: could not write %s\n", outName);
+      exit(EXIT_FAILURE);
+    }
+  free(outName);
+  zb->count = 0;
   return 0;
 }
 
 
-int *readFile(FILE* catfile)
+// splits a row at the commas and buffers its star
+void parseRow(char *line, char *end, const columnmap *map, worker *w)
 {
-  unsigned long long sourceID;
-   char buf[2000];
-   bool headCount = false;
-  while(fgets(buf,1999,catfile)!=NULL)
-    //  while(fscanf(catfile,"%s",buf)==1)
+  unsigned long long sourceID = 0;
+  double starArray[NVALUES];
+  for (int i = 0; i < NVALUES; i++)
+    starArray[i] = CODE_EMPTY;
+  starArray[0] = defaultEpoch;
+
+  char *p = line;
+  for (int c = 0; c < map->numColumns; c++)
     {
-      if (!headCount)
-	{
-	  headCount=true;
-	  continue;
-	}
-     
-      int count94 = 0;
-      int count = 0;
-      double starArray[48];
-      char *token;
-      char *point[]={buf};
+      char *comma = memchr(p, ',', end - p);
+      char *fieldEnd = comma != NULL ? comma : end;
+      if (c == map->sourceColumn)
+        sourceID = strtoull(p, NULL, 10);
+      else if (map->field[c] >= 0)
+        starArray[map->field[c]] = parseValue(p, fieldEnd);
+      if (comma == NULL)
+        break;
+      p = comma + 1;
+    }
+  bufferStar(w,starArray[3],starArray,&sourceID);
+}
 
-      while((token=strsep(point,","))!=NULL)
-	{
-	  if (checkCount(count94))
-	    {
-	      starArray[count] = starASCIIrd(token);
-	      count++;
-	    }
-	  if (count94==2)
-	    sourceID = strtoull(token, NULL,0);
+// reads a decompressed csv file block by block and parses its rows. The first row after the metadata lines
+// is the header. Returns non-zero if the file cannot be read
+int readFile(gzFile catfile, worker *w, const char *fileName)
+{
+  size_t size = READBLOCK;
+  size_t used = 0;
+  char *buf = malloc(size);
+  bool headCount = false;
+  columnmap map;
+  map.field = NULL;
+  int err = 0;
+  while (buf != NULL)
+    {
+      // a row longer than the buffer
+      if (used == size)
+        {
+          size *= 2;
+          buf = realloc(buf, size);
+          if (buf == NULL)
+            break;
+        }
+      int n = gzread(catfile, buf + used, (unsigned)(size - used));
+      if (n < 0)
+        {
+          err = 1;
+          break;
+        }
+      bool eof = n == 0;
+      used += n;
 
-	  count94++;
-	  token = strtok(NULL,",");
-	}
-      writeBin(starArray[3],starArray,&sourceID);
+      char *line = buf;
+      char *end = buf + used;
+      for (;;)
+        {
+          char *newline = memchr(line, '\n', end - line);
+          if (newline == NULL)
+            {
+              // the last row may have no newline
+              if (!eof || line == end)
+                break;
+              newline = end;
+            }
+          char *rowEnd = newline > line && newline[-1] == '\r' ? newline - 1 : newline;
+          if (*line == '#')
+            ;
+          else if (!headCount)
+            {
+              headCount = true;
+              if (mapColumns(line, rowEnd, &map, fileName) != 0)
+                {
+                  printf("error: no source_id column in %s\n", fileName);
+                  err = 1;
+                  break;
+                }
+            }
+          else if (rowEnd > line)
+            parseRow(line, rowEnd, &map, w);
+          line = newline < end ? newline + 1 : end;
+        }
+      used = end - line;
+      memmove(buf, line, used);
+      if (eof || err)
+        break;
     }
-
-  return 0;
-}         
+  if (buf == NULL)
+    {
+      printf("Error: malloc failed in readFile\n");
+      exit(EXIT_FAILURE);
+    }
+  free(buf);
+  free(map.field);
+  return err;
+}
@@ -3,14 +3,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #include "gaiastar.h"
 #include "sllist.h"
 #include "gaia2cat.h"
 #include "gaia2ret.h"
-#include "utils.h"                                                                                                                                                                                                                            
-
-int STARSIZE = sizeof(gaiastar);
+#include "gaia2zone.h"
+#include "gaia2kernel.h"
+#include "mmath.h"
+#include "pmotion.h"
+#include "utils.h"
 
 // FINDING STARS IN GAIA DR2 BASED ON RA AND DEC RANGE:
 // Stars are grouped into 0.2 degree zones in zone files in the sortedBin folder. There are 900 zones.
@@ -20,398 +23,344 @@ int STARSIZE = sizeof(gaiastar);
 // Within each of those zone files, the program narrows down which ra zones must be looked at for the starting and end of the prescribed ra range
 // Within each of the ra zones, the program then conducts a binary search to exactly identify the location of the start and end of the ra range
 // The program then returns every star within those ranges.
+// Zone files are memory mapped (see gaia2zone.c), so the stars are read straight from the mapping.
 
-// This method is the main recursive part of the binary search
-int recursiveSearch(FILE *zFile, int rzIndex1, int rzIndex2, double ra,bool minormax)
+// stars found by a zone scan. The buffer grows as stars are added
+typedef struct
 {
-  int nStars = (rzIndex2-rzIndex1)/STARSIZE;
-  int middleStar = nStars/2;
-  int raMiddleIndex = rzIndex1+middleStar*STARSIZE+16;
-  if(raMiddleIndex>=rzIndex2)
-    return rzIndex2;
-  if(raMiddleIndex<=rzIndex1)
-    return rzIndex1;
-  fseek(zFile,raMiddleIndex,SEEK_SET);
-  double raMiddle;
-  fread((void*)(&raMiddle),sizeof(double),1,zFile);
-  
-  if (raMiddle<ra)
-    {
-      fseek(zFile,raMiddleIndex+STARSIZE,SEEK_SET);
-      double raMiddlePlus1;
-      fread((void*)(&raMiddlePlus1),sizeof(double),1,zFile);
+  gaiastar *stars;
+  int count;
+  int size;
+} starbuf;
 
-      if(raMiddlePlus1>ra)
-        {
-          if (minormax)
-            return rzIndex1+(middleStar+1)*STARSIZE;
-          return rzIndex1+(middleStar)*STARSIZE;
-        }
-        return recursiveSearch(zFile, rzIndex1+(middleStar+1)*STARSIZE,rzIndex2, ra,minormax);
-    }
-  if (raMiddle>ra)
-    {
-      fseek(zFile,raMiddleIndex-STARSIZE,SEEK_SET);
-      double raMiddleMinus1;
-      fread((void*)(&raMiddleMinus1),sizeof(double),1,zFile);
+// visitor that adds a star to a starbuf
+local bool addStar(const gaiastar *star, void *args)
+{
+  starbuf *buf = (starbuf*)args;
 
-      if (raMiddleMinus1<ra)
-        {
-          if (!minormax)
-            return rzIndex1+(middleStar-1)*STARSIZE;
-          return rzIndex1+(middleStar)*STARSIZE;
-        }
-        return recursiveSearch(zFile, rzIndex1, rzIndex1+(middleStar-1)*STARSIZE, ra,minormax);
+  if (buf->count == buf->size)
+    {
+      int size = buf->size > 0 ? 2*buf->size : 1024;
+      gaiastar *stars = realloc(buf->stars, size*sizeof(gaiastar));
+      if (stars == NULL)
+        err_ret_failure("cannot allocate memory for %d stars", size);
+      buf->stars = stars;
+      buf->size = size;
     }
-  else
-    return rzIndex1+(middleStar)*STARSIZE;
-  
+  buf->stars[buf->count++] = *star;
+  return false;
 }
 
-// Binary Search method for finding star in ra and dec range
-int binarySearch(FILE *zFile, int raZone, double ra, bool minormax)//true for min false for max                                                                                                                                                                                
+// a position query: the dec range, the tester with its arguments and the precession of the stars found
+typedef struct
 {
-  fseek(zFile,4*raZone,SEEK_SET);
-  int rzIndex2;
-  fread((void*)(&rzIndex2),sizeof(int),1,zFile);
-  rzIndex2=rzIndex2*STARSIZE+4*1440;
-
-  int rzIndex1;
-  if (raZone==0)
-    rzIndex1=4*1440;
-  else
-    {
-      fseek(zFile,4*(raZone-1),SEEK_SET);
-      fread((void*)(&rzIndex1),sizeof(int),1,zFile);
-      rzIndex1=rzIndex1*STARSIZE+4*1440;
-    }
-  //rzIndex1 is the index for the start of this zone. rzIndex2 is the index for the start of the next zone                                                                                                                                                                      
-  int nStars = (rzIndex2-rzIndex1)/STARSIZE;
-
-  int middleStar = nStars/2;
-  int raMiddleIndex = rzIndex1+middleStar*STARSIZE+16;
-  if(raMiddleIndex>=rzIndex2)
-    return rzIndex2;
-  if(raMiddleIndex<=rzIndex1)
-    return rzIndex1;
-  fseek(zFile,raMiddleIndex,SEEK_SET);
-  double raMiddle;
-  fread((void*)(&raMiddle),sizeof(double),1,zFile);
-  if (raMiddle<ra)
-    {
-      fseek(zFile,raMiddleIndex+STARSIZE,SEEK_SET);
-      double raMiddlePlus1;
-      fread((void*)(&raMiddlePlus1),sizeof(double),1,zFile);
+  double decMin;
+  double decMax;
+  testfunc tester;
+  double ra;
+  double dec;
+  double frame_size;
+  const double *epoch;
+  bool precess;
+  double precession[9];       // see pmotion_precessmatrix2000
+} scanquery;
+
+// candidates are tested in blocks of this many stars
+#define SCAN_BLOCK 256
+
+// positions of a block of candidates, moved to the epoch of the query
+typedef struct
+{
+  long index[SCAN_BLOCK];
+  double ra[SCAN_BLOCK];
+  double dec[SCAN_BLOCK];
+  double pmra[SCAN_BLOCK];
+  double pmdec[SCAN_BLOCK];
+  bool pass[SCAN_BLOCK];
+  int n;
+} scanblock;
+
+// applies proper motion to a block of candidates, tests them and hands the ones that pass to the visitor,
+// precessed if the query asks for it. Returns true if the visitor stopped the walk
+local bool flushBlock(const zonefile *zf, scanblock *b, const scanquery *q,starvisitor visit,void *args,int *count)
+{
+  int n = b->n;
+  b->n = 0;
 
-      if(raMiddlePlus1>ra)
+  if (q->epoch)
+    {
+      for (int k = 0; k < n; k++)
         {
-          if (minormax)
-            return rzIndex1+(middleStar+1)*STARSIZE;
-          return rzIndex1+(middleStar)*STARSIZE;
+          b->pmra[k] = zone_double(zf, GAIA_PMRA, b->index[k]);
+          b->pmdec[k] = zone_double(zf, GAIA_PMDEC, b->index[k]);
         }
-      return recursiveSearch(zFile, rzIndex1+(middleStar+1)*STARSIZE,rzIndex2, ra,minormax);
+      kern_propagate(b->ra, b->dec, b->pmra, b->pmdec, n, *q->epoch - gaia2_refepoch(), NULL);
     }
-  if (raMiddle>ra)
-    {
-      fseek(zFile,raMiddleIndex-STARSIZE,SEEK_SET);
-      double raMiddleMinus1;
-      fread((void*)(&raMiddleMinus1),sizeof(double),1,zFile);
 
-      if (raMiddleMinus1<ra)
-        {
-          if (!minormax)
-            return rzIndex1+(middleStar-1)*STARSIZE;
-          return rzIndex1+(middleStar)*STARSIZE;
-        }
-      return recursiveSearch(zFile, rzIndex1, rzIndex1+(middleStar-1)*STARSIZE, ra,minormax);
+  (*q->tester)(b->ra, b->dec, n, q->ra, q->dec, q->frame_size, b->pass);
+
+  // the tests are done in the frame of the catalog, the stars that passed are moved to the front and precessed
+  int found = 0;
+  for (int k = 0; k < n; k++)
+    if (b->pass[k])
+      {
+        b->index[found] = b->index[k];
+        b->ra[found] = b->ra[k];
+        b->dec[found] = b->dec[k];
+        found++;
+      }
+  if (q->precess)
+    kern_propagate(b->ra, b->dec, NULL, NULL, found, 0, q->precession);
+
+  // the rest of the star is only gathered once it passed
+  for (int k = 0; k < found; k++)
+    {
+      gaiastar newStar;
+      zone_getpos(zf, b->index[k], &newStar);
+      zone_getrest(zf, b->index[k], &newStar);
+      newStar.ra = b->ra[k];
+      newStar.dec = b->dec[k];
+      (*count)++;
+      if ((*visit)(&newStar, args))
+        return true;
     }
-  else
-  return rzIndex1+(middleStar)*STARSIZE;
+  return false;
 }
 
-int posCount(double raMin, double raMax, double decMin, double decMax, testfunc tester,double ra,double dec, double frame_size, const double *epoch)
+// tests every star between minIndex and maxIndex and hands the ones that pass to the visitor.
+// Returns true if the visitor stopped the walk. The zone files hold every star once (gaia2datasort.c removes
+// the duplicates of a resumed gaia2writebin.c), so there is no test for duplicates here.
+local bool scanRange(const zonefile *zf, long minIndex, long maxIndex, const scanquery *q,starvisitor visit,void *args,int *count)
 {
-  int count = 0;
+  scanblock block;
+  block.n = 0;
+  for (long i = minIndex; i < maxIndex; i++)
+    {
+      double dec = zone_double(zf, GAIA_DEC, i);
+      if(dec>q->decMax || dec<q->decMin)
+        continue;
+
+      block.index[block.n] = i;
+      block.ra[block.n] = zone_double(zf, GAIA_RA, i);
+      block.dec[block.n] = dec;
+      if (++block.n == SCAN_BLOCK && flushBlock(zf, &block, q, visit, args, count))
+        return true;
+    }
+  return block.n > 0 && flushBlock(zf, &block, q, visit, args, count);
+}
 
-  bool noRA0 = raMax > raMin;
+// PARALLEL SCAN:
+// With more than one thread the index ranges of the zones are cut into chunks of at most SCAN_CHUNK stars, which a
+// pool of worker threads scans into separate buffers. The calling thread hands each buffer to the visitor as soon
+// as its chunk and all the chunks before it are done, so the stars come out in the same order as from the
+// sequential walk. A worker only takes a chunk within SCAN_WINDOW*nthreads chunks of the next one to be visited,
+// so memory use is bounded by the stars found in that many chunks, not by the size of the zones.
 
-  //dec zones go from 1 to 900                                                                                                                                                                                                                                                 
-                                                                                                                                                                                                                                                                                
-  double dMinPos = decMin + 90.0;
-  double dMaxPos = decMax + 90.0;
-  int dMinZone = (int)(dMinPos/0.2)+1;
-  int dMaxZone = (int)(dMaxPos/0.2)+1;
-  if (dMinPos==180.0)
-    dMinZone=900;
-  if (dMaxPos==180.0)
-    dMaxZone=900;
-
-  //ra zones go from 0 to 1439                                                                                                                                                                                                                                                 
-                                                                                                                                                                                                                                                                                
-  int rMinZone = (int)((raMin)/0.25);
-  if(raMin == 360.0)
-    rMinZone = 1439;
-  int rMaxZone = (int)((raMax)/0.25);
-  if(raMax == 360.0)
-    rMaxZone = 1439;
+#define SCAN_CHUNK 65536
+#define SCAN_WINDOW 2
 
-  char* catpath = "/home/jkim/work/Gaia2Bin/sortedBin/z";
+static int nthreads = 1;
 
-  for(int i = dMinZone; i < dMaxZone + 1; i++)
-    {
+void gaia2cat_setthreads(int n)
+{
+  nthreads = n > 0 ? n : 1;
+}
 
-      char buffer[3];
-      sprintf(buffer,"%d",i);
-      char *fileName = concat(catpath, buffer);
+// a chunk of an index range scanned by one worker
+typedef struct
+{
+  const zonefile *zf;
+  long minIndex;
+  long maxIndex;
+  starbuf found;
+  bool done;
+} scantask;
+
+typedef struct
+{
+  const scanquery *q;
+  scantask *tasks;
+  int numTasks;
+  int nextTask;             // next chunk a worker takes
+  int nextVisit;            // next chunk handed to the visitor
+  int window;               // chunks that may be taken ahead of nextVisit
+  bool stop;                // the visitor stopped the walk
+  pthread_mutex_t lock;
+  pthread_cond_t changed;   // a chunk was done or visited, or the walk stopped
+} scanpool;
+
+local void* scanWorker(void *args)
+{
+  scanpool *pool = (scanpool*)args;
 
-      FILE *zFile = fopen(fileName,"rb");
-      if (zFile == NULL)
-        printf("error: could not open file\n");
+  pthread_mutex_lock(&pool->lock);
+  for (;;)
+    {
+      while (!pool->stop && pool->nextTask < pool->numTasks && pool->nextTask >= pool->nextVisit + pool->window)
+        pthread_cond_wait(&pool->changed, &pool->lock);
+      if (pool->stop || pool->nextTask >= pool->numTasks)
+        break;
+      scantask *task = &pool->tasks[pool->nextTask++];
+      pthread_mutex_unlock(&pool->lock);
+
+      int count = 0;
+      scanRange(task->zf,task->minIndex,task->maxIndex,pool->q,addStar,&task->found,&count);
+
+      pthread_mutex_lock(&pool->lock);
+      task->done = true;
+      pthread_cond_broadcast(&pool->changed);
+    }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
 
-      if(noRA0)
+// cuts an index range into scan tasks
+local void addTasks(scanpool *pool, int *size, const zonefile *zf, long minIndex, long maxIndex)
+{
+  for (long start = minIndex; start < maxIndex; start += SCAN_CHUNK)
+    {
+      if (pool->numTasks == *size)
         {
-          //for the minimum ra:                                                                                                                                                                                                                                                
-                                                                                                                                                                                                                                                                                
-          int minIndex = binarySearch(zFile,rMinZone,raMin,true);
-
-          //for the max ra:                                                                                                                                                                                                                                                   
-                                                                                                                                                                                                                                                                                
-          int maxIndex = binarySearch(zFile,rMaxZone,raMax,false);
-
-          // during the initial run for gaia2writebin.c, there was a point where the program failed and stopped. Because of the vast size of the Gaia DR2,                                                                                                                      
-          // I decided not to start the run from scratch, but continued where the initial run left off. However, because of this, there may be a few duplicates                                                                                                                 
-          // of stars within my sortedBin files. Thus, I include a small check here to eliminate such duplicates.                                                                                                                                                               
-          long id = 0; //test for duplicates by comparing adjacent ids.                                                                                                                                                                                                         
-
-	  for (int i = minIndex; i < maxIndex; i+=STARSIZE)
-            {
-              //read and store each of the stars, checking dec each time. Add the stars to a list                                                                                                                                                                              
-                                                                                                                                                                                                                                                                                
-              fseek(zFile, i+32, SEEK_SET);
-              double starDec;
-              fread((void*)(&starDec), sizeof(double),1, zFile);
-              if(starDec>decMax || starDec<decMin)
-                continue;
-              fseek(zFile,i,SEEK_SET);
-              gaiastar newStar;
-              fread((void*)(&newStar),sizeof(gaiastar),1,zFile);
-
-              if (newStar.source_id==id) // testing for duplicates                                                                                                                                                                                                              
-                continue;
-              id = newStar.source_id;
-
-              if((*tester)(&newStar,ra,dec,frame_size, epoch))
-		count++;
-	    }
+          *size = *size > 0 ? 2 * *size : 64;
+          pool->tasks = realloc(pool->tasks, *size*sizeof(scantask));
+          if (pool->tasks == NULL)
+            err_ret_failure("cannot allocate memory for %d scan tasks", *size);
         }
-      else
-        {
-          long id = 0;
-          //part 1: east                                                                                                                                                                                                                                                       
-                                                                                                                                                                                                                                                                                
-          int minIndex = binarySearch(zFile,0,0.0,true);
-          int maxIndex = binarySearch(zFile,rMaxZone,raMax,false);
-
-          for (int i = minIndex; i < maxIndex; i+=STARSIZE)
-            {
-              //read and store each of the stars, checking dec each time. Add the stars to a list                                                                                                                                                                               
-                                                                                                                                                                                                                                                                               
-
-              fseek(zFile, i+32, SEEK_SET);
-              double starDec;
-              fread((void*)(&starDec), sizeof(double),1, zFile);
-              if(starDec>decMax || starDec<decMin)
-                continue;
-              fseek(zFile,i,SEEK_SET);
-              gaiastar newStar;
-              fread((void*)(&newStar),sizeof(gaiastar),1,zFile);
-
-              if (newStar.source_id==id)// testing for duplicates                                                                                                                                                                                                               
-                continue;
-              id = newStar.source_id;
-
-              if((*tester)(&newStar,ra,dec,frame_size, epoch))
-		count++;
-	    }
-
-	  id = 0;
-
-	  //part 2: west                                                                                                                                                                                                                                                       
-                                                                                                                                                                                                                                                                                
-	  minIndex = binarySearch(zFile,rMinZone,raMin,true);
-	  maxIndex = binarySearch(zFile,1439,360.0,false);
 
-          for (int i = minIndex; i < maxIndex; i+=STARSIZE)
-            {
-              //read and store each of the stars, checking dec each time. Add the stars to a list                                                                                                                                                                               
-
-              fseek(zFile, i+32, SEEK_SET);
-              double starDec;
-              fread((void*)(&starDec), sizeof(double),1, zFile);
-              if(starDec>decMax || starDec<decMin)
-                continue;
-              fseek(zFile,i,SEEK_SET);
-              gaiastar newStar;
-              fread((void*)(&newStar),sizeof(gaiastar),1,zFile);
+      scantask *task = &pool->tasks[pool->numTasks++];
+      task->zf = zf;
+      task->minIndex = start;
+      task->maxIndex = MIN(start + SCAN_CHUNK, maxIndex);
+      task->found.stars = NULL;
+      task->found.count = 0;
+      task->found.size = 0;
+      task->done = false;
+    }
+}
 
-              if (newStar.source_id==id)// testing for duplicates                                                                                                                                                                                                               
-                continue;
-              id = newStar.source_id;
+local int parallelWalk(double raMin, double raMax, int dMinZone, int dMaxZone, const scanquery *q,starvisitor visit,void *args)
+{
+  int count = 0;
+  bool stop = false;
+  int numZones = dMaxZone + 1 - dMinZone;
+
+  zonefile *zones = malloc(numZones*sizeof(zonefile));
+  pthread_t *threads = malloc(nthreads*sizeof(pthread_t));
+  if (zones == NULL || threads == NULL)
+    err_ret_failure("cannot allocate memory for %d threads", nthreads);
+
+  scanpool pool;
+  int size = 0;
+  pool.q = q;
+  pool.tasks = NULL;
+  pool.numTasks = 0;
+  pool.nextTask = 0;
+  pool.nextVisit = 0;
+  pool.window = SCAN_WINDOW*nthreads;
+  pool.stop = false;
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init(&pool.changed, NULL);
+
+  // the zones are mapped once (see gaia2zone.c), only their chunks are listed here
+  bool *opened = malloc(numZones*sizeof(bool));
+  if (opened == NULL)
+    err_ret_failure("cannot allocate memory for %d zones", numZones);
+  for (int z = 0; z < numZones; z++)
+    {
+      opened[z] = zone_open(&zones[z], dMinZone + z);
+      if (!opened[z])
+        {
+          printf("error: could not open file\n");
+          continue;
+        }
 
-              if((*tester)(&newStar,ra,dec,frame_size, epoch))
-		count++;
-	    }
-	}
+      long minIndex[2], maxIndex[2];
+      int numRanges = zone_raranges(&zones[z],raMin,raMax,minIndex,maxIndex);
+      for (int r = 0; r < numRanges; r++)
+        addTasks(&pool,&size,&zones[z],minIndex[r],maxIndex[r]);
+    }
 
-      fclose(zFile);
+  int numThreads = MIN(nthreads, pool.numTasks);
+  for (int t = 0; t < numThreads; t++)
+    if (pthread_create(&threads[t], NULL, scanWorker, &pool) != 0)
+      err_ret_failure("cannot create scan thread");
 
+  // hand the stars to the visitor in order, each chunk once it is done
+  for (int t = 0; t < pool.numTasks && !stop; t++)
+    {
+      scantask *task = &pool.tasks[t];
+      pthread_mutex_lock(&pool.lock);
+      while (!task->done)
+        pthread_cond_wait(&pool.changed, &pool.lock);
+      pthread_mutex_unlock(&pool.lock);
 
+      for (int s = 0; s < task->found.count && !stop; s++)
+        {
+          count++;
+          stop = (*visit)(&task->found.stars[s], args);
+        }
+      free(task->found.stars);
+      task->found.stars = NULL;
+
+      pthread_mutex_lock(&pool.lock);
+      pool.nextVisit = t + 1;
+      pool.stop = stop;
+      pthread_cond_broadcast(&pool.changed);
+      pthread_mutex_unlock(&pool.lock);
     }
-  return count;
 
+  for (int t = 0; t < numThreads; t++)
+    pthread_join(threads[t], NULL);
+  // the chunks scanned after the visitor stopped the walk
+  for (int t = 0; t < pool.numTasks; t++)
+    free(pool.tasks[t].found.stars);
+
+  for (int z = 0; z < numZones; z++)
+    if (opened[z])
+      zone_close(&zones[z]);
+
+  pthread_cond_destroy(&pool.changed);
+  pthread_mutex_destroy(&pool.lock);
+  free(opened);
+  free(pool.tasks);
+  free(threads);
+  free(zones);
+  return count;
 }
-// returns list of stars based on ra and dec range
-int posQuery(double raMin, double raMax, double decMin, double decMax, testfunc tester,double ra,double dec, double frame_size, const double *epoch,gaiastar stars[])
+
+// tests every star of every zone within the ra and dec range, zone by zone, and hands the ones that pass to the visitor
+int posWalk(double raMin, double raMax, double decMin, double decMax, testfunc tester,double ra,double dec, double frame_size, const double *epoch,const double *equinox,starvisitor visit,void *args)
 {
   int count = 0;
+  bool stop = false;
 
-  bool noRA0 = raMax > raMin;
-  
-  //dec zones go from 1 to 900                                                                                                                                                                                                                                                  
-  double dMinPos = decMin + 90.0;
-  double dMaxPos = decMax + 90.0;
-  int dMinZone = (int)(dMinPos/0.2)+1;
-  int dMaxZone = (int)(dMaxPos/0.2)+1;
-  if (dMinPos==180.0)
-    dMinZone=900;
-  if (dMaxPos==180.0)
-    dMaxZone=900;
-
-  //ra zones go from 0 to 1439                                                                                                                                                                                                                                                  
-  int rMinZone = (int)((raMin)/0.25);
-  if(raMin == 360.0)
-    rMinZone = 1439;
-  int rMaxZone = (int)((raMax)/0.25);
-  if(raMax == 360.0)
-    rMaxZone = 1439;
-
-  char* catpath = "/home/jkim/work/Gaia2Bin/sortedBin/z";
-
-    for(int i = dMinZone; i < dMaxZone + 1; i++)
-    {
+  scanquery q = { decMin, decMax, tester, ra, dec, frame_size, epoch, equinox != NULL, {0} };
+  if (equinox)
+    pmotion_precessmatrix2000(*equinox, q.precession);
 
-      char buffer[3];
-      sprintf(buffer,"%d",i);
-      char *fileName = concat(catpath, buffer);
+  int dMinZone = zone_fromdec(decMin);
+  int dMaxZone = zone_fromdec(decMax);
 
-      FILE *zFile = fopen(fileName,"rb");
-      if (zFile == NULL)
-        printf("error: could not open file\n");
+  if (nthreads > 1)
+    return parallelWalk(raMin,raMax,dMinZone,dMaxZone,&q,visit,args);
 
-        if(noRA0)
+  for(int i = dMinZone; i < dMaxZone + 1 && !stop; i++)
+    {
+      zonefile zf;
+      if (!zone_open(&zf, i))
         {
-          //for the minimum ra:                                                                                                                                                                                                                                                 
-          int minIndex = binarySearch(zFile,rMinZone,raMin,true);
-
-          //for the max ra:                                                                                                                                                                                                                                                     
-          int maxIndex = binarySearch(zFile,rMaxZone,raMax,false);
-
-          // during the initial run for gaia2writebin.c, there was a point where the program failed and stopped. Because of the vast size of the Gaia DR2,
-          // I decided not to start the run from scratch, but continued where the initial run left off. However, because of this, there may be a few duplicates
-          // of stars within my sortedBin files. Thus, I include a small check here to eliminate such duplicates.
-          long id = 0; //test for duplicates by comparing adjacent ids.
-
-           for (int i = minIndex; i < maxIndex; i+=STARSIZE)
-            {
-              //read and store each of the stars, checking dec each time. Add the stars to a list                                                                                                                                                                               
-              fseek(zFile, i+32, SEEK_SET);
-              double starDec;
-              fread((void*)(&starDec), sizeof(double),1, zFile);
-              if(starDec>decMax || starDec<decMin)
-                continue;
-              fseek(zFile,i,SEEK_SET);
-              gaiastar newStar;
-              fread((void*)(&newStar),sizeof(gaiastar),1,zFile);
-
-              if (newStar.source_id==id) // testing for duplicates
-                continue;
-              id = newStar.source_id;
-
-              if((*tester)(&newStar,ra,dec,frame_size, epoch))
-		{
-		stars[count]=newStar;
-		count++;
-		}
-               }
+          printf("error: could not open file\n");
+          continue;
         }
-         else
-        {
-	  long id = 0;
-          //part 1: east                                                                                                                                                                                                                                                        
-	  int minIndex = binarySearch(zFile,0,0.0,true);
-          int maxIndex = binarySearch(zFile,rMaxZone,raMax,false);
-	 
-	  for (int i = minIndex; i < maxIndex; i+=STARSIZE)
-            {
-              //read and store each of the stars, checking dec each time. Add the stars to a list                                                                                                              
-                                                                                                                                                                                                                                                                                
-              fseek(zFile, i+32, SEEK_SET);
-              double starDec;
-              fread((void*)(&starDec), sizeof(double),1, zFile);
-              if(starDec>decMax || starDec<decMin)
-                continue;
-              fseek(zFile,i,SEEK_SET);
-              gaiastar newStar;
-              fread((void*)(&newStar),sizeof(gaiastar),1,zFile);
-
-              if (newStar.source_id==id)// testing for duplicates
-                continue;
-              id = newStar.source_id;
-
-              if((*tester)(&newStar,ra,dec,frame_size, epoch))
-		{
-		stars[count]=newStar;
-		count++;
-		}
-		}
-
-            id = 0;
-          //part 2: west                                                                                                                                                                                                                                                        
-	     minIndex = binarySearch(zFile,rMinZone,raMin,true);
-	     maxIndex = binarySearch(zFile,1439,360.0,false);
-	   
-	  for (int i = minIndex; i < maxIndex; i+=STARSIZE)
-            {
-              //read and store each of the stars, checking dec each time. Add the stars to a list
-
-              fseek(zFile, i+32, SEEK_SET);
-              double starDec;
-              fread((void*)(&starDec), sizeof(double),1, zFile);
-              if(starDec>decMax || starDec<decMin)
-                continue;
-              fseek(zFile,i,SEEK_SET);
-              gaiastar newStar;
-              fread((void*)(&newStar),sizeof(gaiastar),1,zFile);
-
-              if (newStar.source_id==id)// testing for duplicates
-                continue;
-              id = newStar.source_id;
-
-              if((*tester)(&newStar,ra,dec,frame_size, epoch))
-		{
-		stars[count]=newStar;
-		count++;
-		}
-		}
-            }
-
-      fclose(zFile);
-
-
-      }
-    return 0;
 
+      long minIndex[2], maxIndex[2];
+      int numRanges = zone_raranges(&zf,raMin,raMax,minIndex,maxIndex);
+      for (int r = 0; r < numRanges && !stop; r++)
+        stop = scanRange(&zf,minIndex[r],maxIndex[r],&q,visit,args,&count);
 
+      zone_close(&zf);
+    }
+  return count;
 }
 
 /*// main method for testing                                                                                                                                                                                                                                                      
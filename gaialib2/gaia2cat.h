@@ -1,13 +1,28 @@
+#ifndef GAIA2_CAT_H__
+#define GAIA2_CAT_H__
+
 #include <stdbool.h>
 
-typedef bool (*testfunc) (
-    gaiastar*          star,
+#include "gaiastar.h"
+
+// tests a block of n stars: ra and dec [deg] are their positions at the epoch of the query and
+// pass[i] is set to whether star i is within the field of the given size around centRA, centDec
+typedef void (*testfunc) (
+    const double       ra[],
+    const double       dec[],
+    int                n,
     double             centRA,
     double             centDec,
     double             half_size,
-    const double*       epoch
+    bool               pass[]
 );
 
-int posQuery(double raMin, double raMax, double decMin, double decMax, testfunc tester,double ra,double dec, double frame_size, const double *epoch,gaiastar stars[]);
+// hands every star within the ra and dec range that passes the tester to the visitor, zone by zone. The proper motion
+// of the stars is applied first if epoch is not NULL, and the stars found are precessed to equinox [years] if it is
+// not NULL. Returns the number of stars visited
+int posWalk(double raMin, double raMax, double decMin, double decMax, testfunc tester,double ra,double dec, double frame_size, const double *epoch,const double *equinox,starvisitor visit,void *args);
+
+// number of threads that scan zone files in parallel, 1 scans them in sequence
+void gaia2cat_setthreads(int n);
 
-int posCount(double raMin, double raMax, double decMin, double decMax, testfunc tester,double ra,double dec, double frame_size, const double *epoch);
+#endif
@@ -0,0 +1,268 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "gaia2catalog.h"
+#include "utils.h"
+
+// CATALOG MANIFEST:
+// The zone geometry, the record size, the star counts and the paths of the layouts and the ID files are read
+// once from the manifest of the catalog directory, instead of being compiled into the query code. zone_open
+// and the ID lookups take their paths from catalog_get, so a query can be pointed at another release or build
+// with --cat. The catalog stays a directory of zone files, so the offset of every zone is the start of its file.
+
+// files of the catalogs built before the manifest, relative to GAIA2_CATPATH. The cross-ID files are in the
+// Gaia2Mass directory next to the catalog, where gaia2manifest.c looks for them
+static const char *defaultZonePaths[ZONE_NLAYOUTS] = {"sortedBin/z", "sortedCol/z", "sortedAst/z"};
+static const char *defaultPhotPath = "sortedPhot/z";
+static const char *defaultIDIndex = "IDIndex/ids";
+static const char *defaultIDSort = "IDSTSort/id";
+static const char *defaultCrossID[CROSSID_NTYPES] = {"../Gaia2Mass/IDgaiaSort",
+                                                     "../Gaia2Mass/IDtmassSort",
+                                                     "../Gaia2Mass/IDhatSort"};
+static const char *defaultCrossIDStore = "../Gaia2Mass/IDcross";
+static const char *crossIDNames[CROSSID_NTYPES] = {"gaia", "tmass", "hat"};
+
+static gaia2catalog catalog;
+static bool opened = false;
+
+// a path of the manifest, relative to the catalog directory unless it is absolute
+local char* catalogPath(const char *dir, const char *path)
+{
+  if (path[0] == '/')
+    return concat(path, "");
+  char *prefix = concat(dir, "/");
+  char *result = concat(prefix, path);
+  free(prefix);
+  return result;
+}
+
+local void freeCatalog(gaia2catalog *cat)
+{
+  free(cat->path);
+  free(cat->release);
+  for (int l = 0; l < ZONE_NLAYOUTS; l++)
+    free(cat->zonePaths[l]);
+  free(cat->photPath);
+  free(cat->idIndex);
+  free(cat->idSort);
+  for (int c = 0; c < CROSSID_NTYPES; c++)
+    free(cat->crossID[c]);
+  free(cat->crossIDStore);
+  memset(cat, 0, sizeof(gaia2catalog));
+}
+
+// fills in the paths of the catalogs without a manifest
+local void defaultCatalog(gaia2catalog *cat, const char *path)
+{
+  cat->path = concat(path, "");
+  cat->manifest = false;
+  cat->release = concat("DR2", "");
+  cat->refepoch = GAIA2_REFEPOCH;
+  for (int l = 0; l < ZONE_NLAYOUTS; l++)
+    cat->zonePaths[l] = catalogPath(path, defaultZonePaths[l]);
+  cat->photPath = catalogPath(path, defaultPhotPath);
+  for (int z = 0; z <= GAIA2_NZONES; z++)
+    cat->zoneStars[z] = -1;
+  cat->idIndex = catalogPath(path, defaultIDIndex);
+  cat->idSort = catalogPath(path, defaultIDSort);
+  for (int c = 0; c < CROSSID_NTYPES; c++)
+    cat->crossID[c] = catalogPath(path, defaultCrossID[c]);
+  cat->crossIDStore = catalogPath(path, defaultCrossIDStore);
+}
+
+// reads the manifest over the defaults, returns false with a message if a line is not understood or the
+// catalog was written for another geometry or record
+local bool readManifest(gaia2catalog *cat, FILE *in, const char *fileName)
+{
+  char line[4096], key[64], value[1024], value2[1024], value3[1024];
+  int version = 0, lineNumber = 0;
+  bool layouts = false;
+
+  while (fgets(line, sizeof(line), in) != NULL)
+    {
+      lineNumber++;
+      char *comment = strchr(line, '#');
+      if (comment != NULL)
+        *comment = '\0';
+      int n = sscanf(line, "%63s %1023s %1023s %1023s", key, value, value2, value3);
+      if (n < 1)
+        continue;
+      if (n < 2)
+        {
+          err_print_msg("%s:%d: %s has no value", fileName, lineNumber, key);
+          return false;
+        }
+
+      if (!strcmp(key, "version"))
+        version = atoi(value);
+      else if (!strcmp(key, "release"))
+        {
+          free(cat->release);
+          cat->release = concat(value, "");
+        }
+      else if (!strcmp(key, "refepoch"))
+        cat->refepoch = atof(value);
+      else if (!strcmp(key, "zones"))
+        {
+          if (n < 3 || atoi(value) != GAIA2_NZONES || atof(value2) != 0.2)
+            {
+              err_print_msg("%s: the catalog has zones %s %s, this build reads %d zones of 0.2 degrees",
+                            fileName, value, n < 3 ? "" : value2, GAIA2_NZONES);
+              return false;
+            }
+        }
+      else if (!strcmp(key, "razones"))
+        {
+          if (atoi(value) != GAIA2_NRAZONES)
+            {
+              err_print_msg("%s: the catalog has %s ra zones, this build reads %d", fileName, value, GAIA2_NRAZONES);
+              return false;
+            }
+        }
+      else if (!strcmp(key, "recordsize"))
+        {
+          if (atol(value) != (long)sizeof(gaiastar))
+            {
+              err_print_msg("%s: the catalog has %s byte records, this build reads %d", fileName, value,
+                            (int)sizeof(gaiastar));
+              return false;
+            }
+        }
+      else if (!strcmp(key, "layout"))
+        {
+          // the layouts of the manifest replace the default ones
+          if (!layouts)
+            {
+              for (int l = 0; l < ZONE_NLAYOUTS; l++)
+                {
+                  free(cat->zonePaths[l]);
+                  cat->zonePaths[l] = NULL;
+                }
+              free(cat->photPath);
+              cat->photPath = NULL;
+              layouts = true;
+            }
+          int l = 0;
+          while (l < ZONE_NLAYOUTS && strcmp(value, zone_layoutnames[l]))
+            l++;
+          if (l == ZONE_NLAYOUTS)
+            {
+              err_print_msg("%s:%d: invalid layout", fileName, lineNumber);
+              return false;
+            }
+          if (n < (l == ZONE_SPLIT ? 4 : 3))
+            {
+              err_print_msg("%s:%d: layout %s has no path", fileName, lineNumber, value);
+              return false;
+            }
+          free(cat->zonePaths[l]);
+          cat->zonePaths[l] = catalogPath(cat->path, value2);
+          // the split layout has the sortedAst and the sortedPhot prefix
+          if (l == ZONE_SPLIT)
+            {
+              free(cat->photPath);
+              cat->photPath = catalogPath(cat->path, value3);
+            }
+        }
+      else if (!strcmp(key, "idindex"))
+        {
+          free(cat->idIndex);
+          cat->idIndex = catalogPath(cat->path, value);
+        }
+      else if (!strcmp(key, "idsort"))
+        {
+          free(cat->idSort);
+          cat->idSort = catalogPath(cat->path, value);
+        }
+      else if (!strcmp(key, "crossid"))
+        {
+          int c = 0;
+          while (c < CROSSID_NTYPES && strcmp(value, crossIDNames[c]))
+            c++;
+          if (c == CROSSID_NTYPES || n < 3)
+            {
+              err_print_msg("%s:%d: invalid cross-ID file", fileName, lineNumber);
+              return false;
+            }
+          free(cat->crossID[c]);
+          cat->crossID[c] = catalogPath(cat->path, value2);
+        }
+      else if (!strcmp(key, "crossidstore"))
+        {
+          free(cat->crossIDStore);
+          cat->crossIDStore = catalogPath(cat->path, value);
+        }
+      else if (!strcmp(key, "zone"))
+        {
+          int zone = atoi(value);
+          if (zone < 1 || zone > GAIA2_NZONES || n < 3)
+            {
+              err_print_msg("%s:%d: invalid zone", fileName, lineNumber);
+              return false;
+            }
+          cat->zoneStars[zone] = atol(value2);
+        }
+      else
+        {
+          err_print_msg("%s:%d: unknown entry %s", fileName, lineNumber, key);
+          return false;
+        }
+    }
+
+  if (version != GAIA2_CATVERSION)
+    {
+      err_print_msg("%s: catalog version %d, this build reads version %d", fileName, version, GAIA2_CATVERSION);
+      return false;
+    }
+  return true;
+}
+
+bool catalog_open(const char *path)
+{
+  struct stat st;
+  if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+      err_print_msg("%s is not a catalog directory", path);
+      return false;
+    }
+
+  gaia2catalog cat;
+  memset(&cat, 0, sizeof(gaia2catalog));
+  defaultCatalog(&cat, path);
+
+  char *prefix = concat(path, "/");
+  char *fileName = concat(prefix, GAIA2_MANIFEST);
+  free(prefix);
+  FILE *in = fopen(fileName, "r");
+  if (in != NULL)
+    {
+      cat.manifest = true;
+      bool valid = readManifest(&cat, in, fileName);
+      fclose(in);
+      if (!valid)
+        {
+          free(fileName);
+          freeCatalog(&cat);
+          return false;
+        }
+    }
+  free(fileName);
+
+  // the mappings of the zone files belong to the catalog that was open
+  zone_closeall();
+  if (opened)
+    freeCatalog(&catalog);
+  catalog = cat;
+  opened = true;
+  return true;
+}
+
+const gaia2catalog* catalog_get(void)
+{
+  if (!opened && !catalog_open(GAIA2_CATPATH))
+    err_ret_failure("cannot open the catalog %s", GAIA2_CATPATH);
+  return &catalog;
+}
@@ -0,0 +1,63 @@
+#ifndef GAIA2_CATALOG_H__
+#define GAIA2_CATALOG_H__
+
+#include <stdbool.h>
+
+#include "gaia2zone.h"
+
+// A catalog is a directory with a manifest (GAIA2_MANIFEST), a text file of "<key> <values>" lines written by
+// DataPreparation/gaia2manifest.c:
+//   version 1
+//   release DR2                          name of the Gaia release
+//   refepoch 2015.5                      epoch of the positions [years]
+//   zones 900 0.2                        number and height [deg] of the dec zones
+//   razones 1440                         ra zones in the header of each zone file
+//   recordsize 296                       sizeof(gaiastar) of the build that wrote the zone files
+//   layout rows sortedBin/z              prefix of the zone files of each layout that was built,
+//   layout columns sortedCol/z           the split layout has the sortedAst and the sortedPhot prefix
+//   layout split sortedAst/z sortedPhot/z
+//   idindex IDIndex/ids                  numeric ID index (gaia2idindex.h)
+//   idsort IDSTSort/id                   prefix of the older IDSTSort files
+//   crossid gaia|tmass|hat <file>        cross-ID files sorted by each kind of ID
+//   crossidstore <file>                  cross-ID store that replaces them (gaia2crossid.h)
+//   zone <zone> <stars>                  number of stars of each zone
+// The paths are relative to the catalog directory unless they start with /. A directory without a manifest
+// is read with the paths of the DR2 catalog of GAIA2_CATPATH, so the catalogs built before the manifest
+// still work. Several catalogs (releases or versions) can be kept side by side and chosen with gaia2read --cat.
+
+#define GAIA2_CATPATH "/home/jkim/work/Gaia2Bin"
+#define GAIA2_MANIFEST "catalog"
+#define GAIA2_CATVERSION 1
+
+typedef enum
+{
+  CROSSID_GAIA,
+  CROSSID_TMASS,
+  CROSSID_HAT,
+  CROSSID_NTYPES
+} crossidtype;
+
+typedef struct
+{
+  char *path;                         // directory of the catalog
+  bool manifest;                      // whether the catalog has a manifest
+  char *release;
+  double refepoch;
+  char *zonePaths[ZONE_NLAYOUTS];     // prefix of the zone files of each zonelayout, NULL if not built
+  char *photPath;                     // prefix of the sortedPhot files of the split layout
+  long zoneStars[GAIA2_NZONES+1];     // stars of each zone (1 ... 900), -1 if the manifest does not say
+  char *idIndex;
+  char *idSort;
+  char *crossID[CROSSID_NTYPES];
+  char *crossIDStore;
+} gaia2catalog;
+
+// reads the manifest of the catalog in the directory path and makes it the catalog of the queries. The zone
+// files of the catalog that was open before are unmapped. Returns false if the manifest cannot be read or
+// does not match this build
+bool catalog_open(const char *path);
+
+// catalog of the queries, the one of GAIA2_CATPATH if catalog_open was not called
+const gaia2catalog* catalog_get(void);
+
+#endif
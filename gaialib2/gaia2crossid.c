@@ -0,0 +1,338 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gaia2crossid.h"
+#include "utils.h"
+
+// BATCHED CROSS-IDENTIFICATION:
+// The cross-ID files are mapped on their first use and kept for the rest of the run. The Gaia ids of a result
+// set are sorted and merged with the rows sorted by Gaia id: the join only moves forward, galloping from the
+// last match to the next one, so a batch costs one pass over the pages between its ids instead of a binary
+// search from the whole file for every star.
+//
+// CROSS-ID STORE:
+// The store (see gaia2crossid.h) is used when the catalog has one, else the three sorted files. The join gallops
+// over the block index and decodes each block it lands in once, the 2MASS and HAT IDs are then read from their
+// columns by row number. The 2MASS and HAT searches go through the row permutations, and the Gaia id of the
+// row that matches is decoded from its block.
+
+// a cross-ID file mapped into memory
+typedef struct
+{
+  const crossidrecord *rows;
+  long numRows;
+  bool mapped;
+} crossidfile;
+
+static crossidfile crossIDs[CROSSID_NTYPES];
+
+// the cross-ID store mapped into memory
+typedef struct
+{
+  const crossidheader *header;
+  const long *tmass;
+  const long *hat;
+  const unsigned int *tmassPerm;
+  const unsigned int *hatPerm;
+  const unsigned char *gaia;
+  const long *blocks;        // first Gaia id and offset of the varints of each block
+} crossidstore;
+
+static crossidstore store;
+static int storeState = 0;  // 0: not tried yet, 1: mapped, -1: not available
+
+// a Gaia id to resolve and its place in the result
+typedef struct
+{
+  long id;
+  int index;
+} crossidrequest;
+
+local const crossidfile* mapCrossID(crossidtype type)
+{
+  crossidfile *cf = &crossIDs[type];
+  if (cf->mapped)
+    return cf;
+
+  const char *fileName = catalog_get()->crossID[type];
+  int fd = open(fileName, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0)
+    err_ret_failure("cannot open the cross-ID file %s", fileName);
+
+  cf->numRows = st.st_size/sizeof(crossidrecord);
+  if (cf->numRows > 0)
+    {
+      void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (map == MAP_FAILED)
+        err_ret_failure("cannot map the cross-ID file %s", fileName);
+      cf->rows = (const crossidrecord*)map;
+    }
+  close(fd);
+  cf->mapped = true;
+  return cf;
+}
+
+// whether a section of count items of the given size fits in the store
+local bool sectionFits(long offset, long count, size_t itemSize, size_t size)
+{
+  return offset >= CROSSID_DATAOFFSET && count >= 0 && (size_t)offset <= size
+    && (size_t)count <= (size - offset)/itemSize;
+}
+
+// maps the cross-ID store of the catalog on the first call. Returns false if there is none
+local bool openStore(void)
+{
+  if (storeState != 0)
+    return storeState > 0;
+  storeState = -1;
+
+  const char *fileName = catalog_get()->crossIDStore;
+  int fd = open(fileName, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < CROSSID_DATAOFFSET)
+    {
+      close(fd);
+      return false;
+    }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  const crossidheader *h = (const crossidheader*)map;
+  size_t size = st.st_size;
+  bool valid = memcmp(h->magic, CROSSID_MAGIC, sizeof(h->magic)) == 0 && h->version == CROSSID_VERSION
+    && h->blockSize == CROSSID_BLOCK && h->numRows >= 0 && h->numRows <= 0xffffffffL
+    && h->numBlocks == (h->numRows + CROSSID_BLOCK - 1)/CROSSID_BLOCK
+    && h->numTmass <= h->numRows && h->numHat <= h->numRows
+    && sectionFits(h->tmassOffset, h->numRows, sizeof(long), size)
+    && sectionFits(h->hatOffset, h->numRows, sizeof(long), size)
+    && sectionFits(h->tmassPermOffset, h->numTmass, sizeof(unsigned int), size)
+    && sectionFits(h->hatPermOffset, h->numHat, sizeof(unsigned int), size)
+    && sectionFits(h->gaiaOffset, h->gaiaSize, 1, size)
+    && sectionFits(h->blockOffset, 2*h->numBlocks, sizeof(long), size);
+  if (!valid)
+    {
+      err_print_msg("%s is not a valid cross-ID store, rebuild it with gaia2crossbin", fileName);
+      munmap(map, size);
+      return false;
+    }
+
+  const char *base = (const char*)map;
+  store.header = h;
+  store.tmass = (const long*)(base + h->tmassOffset);
+  store.hat = (const long*)(base + h->hatOffset);
+  store.tmassPerm = (const unsigned int*)(base + h->tmassPermOffset);
+  store.hatPerm = (const unsigned int*)(base + h->hatPermOffset);
+  store.gaia = (const unsigned char*)(base + h->gaiaOffset);
+  store.blocks = (const long*)(base + h->blockOffset);
+  storeState = 1;
+  return true;
+}
+
+// decodes the Gaia ids of block b, returns their number
+local int decodeBlock(long b, long ids[CROSSID_BLOCK])
+{
+  const crossidheader *h = store.header;
+  int n = b < h->numBlocks - 1 ? CROSSID_BLOCK : (int)(h->numRows - b*CROSSID_BLOCK);
+  const unsigned char *p = store.gaia + (store.blocks[2*b+1] < h->gaiaSize ? store.blocks[2*b+1] : h->gaiaSize);
+  const unsigned char *end = store.gaia + h->gaiaSize;
+
+  ids[0] = store.blocks[2*b];
+  for (int i = 1; i < n; i++)
+    {
+      unsigned long delta = 0;
+      int shift = 0;
+      while (p < end && (*p & 0x80))
+        {
+          delta |= (unsigned long)(*p++ & 0x7f) << shift;
+          shift += 7;
+        }
+      if (p < end)
+        delta |= (unsigned long)*p++ << shift;
+      ids[i] = ids[i-1] + (long)delta;
+    }
+  return n;
+}
+
+local inline long blockFirst(long b)
+{
+  return store.blocks[2*b];
+}
+
+local inline long crossidField(const crossidrecord *row, crossidtype type)
+{
+  return type == CROSSID_TMASS ? row->tmass : type == CROSSID_HAT ? row->hat : row->gaia;
+}
+
+local int requestcmp(const void *a, const void *b)
+{
+  long x = ((const crossidrequest*)a)->id;
+  long y = ((const crossidrequest*)b)->id;
+  return x < y ? -1 : x > y;
+}
+
+// joins the sorted requests with the rows of the store
+local void joinStore(const crossidrequest requests[], int count, crossidtype out, long result[])
+{
+  long numBlocks = store.header->numBlocks;
+  long ids[CROSSID_BLOCK];
+  long decoded = -1;  // block held in ids
+  int n = 0;
+  long b = 0;         // last block whose first id is below the id, or the first block
+
+  for (int i = 0; i < count; i++)
+    {
+      long id = requests[i].id;
+      result[requests[i].index] = 0;
+      if (numBlocks == 0)
+        continue;
+
+      if (b + 1 < numBlocks && blockFirst(b + 1) < id)
+        {
+          long lo = b + 1, step = 1;
+          while (lo + step < numBlocks && blockFirst(lo + step) < id)
+            {
+              lo += step;
+              step *= 2;
+            }
+          long hi = lo + step < numBlocks ? lo + step : numBlocks;
+          while (hi - lo > 1)
+            {
+              long mid = lo + (hi - lo)/2;
+              if (blockFirst(mid) < id)
+                lo = mid;
+              else
+                hi = mid;
+            }
+          b = lo;
+        }
+      if (decoded != b)
+        {
+          n = decodeBlock(b, ids);
+          decoded = b;
+        }
+
+      // first row at or above the id, in this block or else the first one of the next
+      int lo = 0, hi = n;
+      while (lo < hi)
+        {
+          int mid = lo + (hi - lo)/2;
+          if (ids[mid] < id)
+            lo = mid + 1;
+          else
+            hi = mid;
+        }
+      long row = b*CROSSID_BLOCK + lo;
+      bool found = lo < n ? ids[lo] == id : b + 1 < numBlocks && blockFirst(b + 1) == id;
+      if (found)
+        result[requests[i].index] = out == CROSSID_TMASS ? store.tmass[row] : out == CROSSID_HAT ? store.hat[row] : id;
+    }
+}
+
+// joins the sorted requests with the rows of IDgaiaSort
+local void joinFile(const crossidrequest requests[], int count, crossidtype out, long result[])
+{
+  const crossidfile *cf = mapCrossID(CROSSID_GAIA);
+  const crossidrecord *rows = cf->rows;
+  long numRows = cf->numRows;
+  long pos = 0;  // first row that may match the next id
+  for (int i = 0; i < count; i++)
+    {
+      long id = requests[i].id;
+      if (pos < numRows && rows[pos].gaia < id)
+        {
+          // gallop to a row at or above the id, then bisect the last step: rows[lo] is below it, rows[hi] is not
+          long lo = pos, step = 1;
+          while (lo + step < numRows && rows[lo + step].gaia < id)
+            {
+              lo += step;
+              step *= 2;
+            }
+          long hi = lo + step < numRows ? lo + step : numRows;
+          while (hi - lo > 1)
+            {
+              long mid = lo + (hi - lo)/2;
+              if (rows[mid].gaia < id)
+                lo = mid;
+              else
+                hi = mid;
+            }
+          pos = hi;
+        }
+      result[requests[i].index] = pos < numRows && rows[pos].gaia == id ? crossidField(&rows[pos], out) : 0;
+    }
+}
+
+long* crossid_fromgaia(const long gaiaIDs[], int count, crossidtype out)
+{
+  long *result = malloc((count > 0 ? count : 1)*sizeof(long));
+  crossidrequest *requests = malloc((count > 0 ? count : 1)*sizeof(crossidrequest));
+  if (result == NULL || requests == NULL)
+    err_ret_failure("cannot allocate memory for %d cross-IDs", count);
+
+  for (int i = 0; i < count; i++)
+    {
+      requests[i].id = gaiaIDs[i];
+      requests[i].index = i;
+    }
+  qsort(requests, count, sizeof(crossidrequest), requestcmp);
+
+  if (openStore())
+    joinStore(requests, count, out, result);
+  else
+    joinFile(requests, count, out, result);
+
+  free(requests);
+  return result;
+}
+
+long crossid_togaia(long id, crossidtype in)
+{
+  if (openStore())
+    {
+      const unsigned int *perm = in == CROSSID_TMASS ? store.tmassPerm : store.hatPerm;
+      const long *column = in == CROSSID_TMASS ? store.tmass : store.hat;
+      long start = 0, end = (in == CROSSID_TMASS ? store.header->numTmass : store.header->numHat) - 1;
+      while (start <= end)
+        {
+          long mid = start + (end - start)/2;
+          long row = perm[mid];
+          if (column[row] < id)
+            start = mid + 1;
+          else if (column[row] > id)
+            end = mid - 1;
+          else
+            {
+              long ids[CROSSID_BLOCK];
+              decodeBlock(row/CROSSID_BLOCK, ids);
+              return ids[row % CROSSID_BLOCK];
+            }
+        }
+      return 0;
+    }
+
+  const crossidfile *cf = mapCrossID(in);
+  long start = 0, end = cf->numRows - 1;
+  while (start <= end)
+    {
+      long mid = start + (end - start)/2;
+      long fileID = crossidField(&cf->rows[mid], in);
+      if (fileID < id)
+        start = mid + 1;
+      else if (fileID > id)
+        end = mid - 1;
+      else
+        return cf->rows[mid].gaia;
+    }
+  return 0;
+}
@@ -0,0 +1,57 @@
+#ifndef GAIA2_CROSSID_H__
+#define GAIA2_CROSSID_H__
+
+#include "gaia2catalog.h"
+
+// The cross-ID files (IDgaiaSort, IDtmassSort, IDhatSort, see gaia2catalog.h) hold the same crossidrecord rows,
+// each file sorted by one of the IDs. An ID that is not known is 0.
+typedef struct
+{
+  long gaia;
+  long tmass;
+  long hat;
+} crossidrecord;
+
+// The cross-ID store (IDcross) replaces the three sorted files with a single copy of the rows, sorted by Gaia
+// id, written by DataPreparation/gaia2crossbin.c from IDgaiaSort:
+//   a crossidheader padded to CROSSID_DATAOFFSET
+//   the 2MASS IDs of the rows (long), then their HAT IDs (long)
+//   the rows with a 2MASS ID in the order of the 2MASS IDs (unsigned int row numbers), then the same for HAT
+//   the Gaia ids cut into blocks of CROSSID_BLOCK rows: the first id of a block is in the block index, the
+//   others are the differences to the previous id as base 128 varints (7 bits a byte, low bits first, the
+//   high bit set on all bytes but the last)
+//   the block index: the first Gaia id and the byte offset of the varints of each block (long pairs)
+// A row takes about 29 bytes instead of the 72 of the three sorted files.
+#define CROSSID_MAGIC "GAIA2XID"
+#define CROSSID_VERSION 1
+
+#define CROSSID_DATAOFFSET 4096
+#define CROSSID_BLOCK 128
+
+typedef struct
+{
+  char magic[8];
+  int version;
+  int blockSize;       // CROSSID_BLOCK
+  long numRows;
+  long numBlocks;
+  long numTmass;       // rows with a 2MASS ID
+  long numHat;         // rows with a HAT ID
+  long tmassOffset;    // byte offsets of the sections
+  long hatOffset;
+  long tmassPermOffset;
+  long hatPermOffset;
+  long gaiaOffset;
+  long gaiaSize;       // bytes of varints
+  long blockOffset;
+} crossidheader;
+
+// the IDs of the kind out of count Gaia source ids, in the same order, 0 for the ones without a match. The ids
+// are sorted and joined with the cross-ID store (or IDgaiaSort without one) in one pass. The array is allocated
+// and must be freed by the caller
+long* crossid_fromgaia(const long gaiaIDs[], int count, crossidtype out);
+
+// the Gaia source id of a 2MASS or HAT ID (in is CROSSID_TMASS or CROSSID_HAT), 0 if it is not known
+long crossid_togaia(long id, crossidtype in);
+
+#endif
@@ -0,0 +1,175 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gaia2idindex.h"
+#include "gaia2catalog.h"
+#include "utils.h"
+
+#if defined(__GNUC__)
+#define IDX_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define IDX_PREFETCH(p)
+#endif
+
+// ids of a sorted batch whose blocks are prefetched ahead of the one being searched
+#define FIND_AHEAD 8
+
+bool idindex_open(idindex *ix)
+{
+  memset(ix, 0, sizeof(idindex));
+
+  const char *indexpath = catalog_get()->idIndex;
+  int fd = open(indexpath, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < IDINDEX_DATAOFFSET)
+    {
+      close(fd);
+      return false;
+    }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+  ix->map = map;
+  ix->size = st.st_size;
+
+  const idindexheader *h = (const idindexheader*)map;
+  size_t size = ix->size;
+  bool valid = memcmp(h->magic, IDINDEX_MAGIC, sizeof(h->magic)) == 0 && h->version == IDINDEX_VERSION
+    && h->recordSize == (int)sizeof(IDElement) && h->blockSize == IDINDEX_BLOCK && h->fencePage == IDINDEX_FENCEPAGE
+    && h->numStars >= 0 && (size_t)h->numStars <= (size - IDINDEX_DATAOFFSET)/sizeof(IDElement)
+    && h->numBlocks == (h->numStars + IDINDEX_BLOCK - 1)/IDINDEX_BLOCK
+    && h->numTop == (h->numBlocks + IDINDEX_FENCEPAGE - 1)/IDINDEX_FENCEPAGE
+    && h->fenceOffset >= 0 && (size_t)h->fenceOffset <= size && (size_t)h->numBlocks <= (size - h->fenceOffset)/sizeof(long)
+    && h->topOffset >= 0 && (size_t)h->topOffset <= size && (size_t)(h->numTop + 1) <= (size - h->topOffset)/(2*sizeof(long));
+  if (!valid)
+    {
+      err_print_msg("%s is not a valid ID index, rebuild it with gaia2idnumsort", indexpath);
+      idindex_close(ix);
+      return false;
+    }
+
+  ix->ids = (const IDElement*)((const char*)map + IDINDEX_DATAOFFSET);
+  ix->numStars = h->numStars;
+  ix->fences = (const long*)((const char*)map + h->fenceOffset);
+  ix->numBlocks = h->numBlocks;
+
+  // the top tree is searched for every id, it is copied to cache line aligned memory
+  const long *top = (const long*)((const char*)map + h->topOffset);
+  void *copy = NULL;
+  if (posix_memalign(&copy, 64, 2*(h->numTop + 1)*sizeof(long)) != 0)
+    {
+      err_print_msg("cannot allocate memory for the ID index");
+      idindex_close(ix);
+      return false;
+    }
+  memcpy(copy, top, 2*(h->numTop + 1)*sizeof(long));
+  ix->top = (long*)copy;
+  ix->topPage = ix->top + h->numTop + 1;
+  ix->numTop = h->numTop;
+  return true;
+}
+
+void idindex_close(idindex *ix)
+{
+  if (ix->map != NULL)
+    munmap(ix->map, ix->size);
+  free(ix->top);
+  memset(ix, 0, sizeof(idindex));
+}
+
+// block where the first record of sourceID would be: the last block whose first id is below it, or the first block
+local long findBlock(const idindex *ix, long sourceID)
+{
+  // descend the top tree, going right at every key below the id. The cache line of the nodes three
+  // levels down is fetched while the comparisons go on
+  long k = 1;
+  while (k <= ix->numTop)
+    {
+      IDX_PREFETCH(ix->top + 8*k);
+      k = 2*k + (ix->top[k] < sourceID);
+    }
+  // dropping the right turns at the end of the path and the last left turn gives the first key not below the id
+  while (k & 1)
+    k >>= 1;
+  k >>= 1;
+  long page = k == 0 ? ix->numTop - 1 : ix->topPage[k] - 1;
+  if (page < 0)
+    return 0;
+
+  // last fence of the page that is below the id
+  long start = page*IDINDEX_FENCEPAGE;
+  long end = start + IDINDEX_FENCEPAGE < ix->numBlocks ? start + IDINDEX_FENCEPAGE : ix->numBlocks;
+  while (start < end)
+    {
+      long mid = (end-start)/2 + start;
+      if (ix->fences[mid] < sourceID)
+        start = mid+1;
+      else
+        end = mid;
+    }
+  return start-1;
+}
+
+// binary search for the first record of a source_id within a block, it may also be the first record of the next block
+local const IDElement* searchBlock(const idindex *ix, long block, long sourceID)
+{
+  long start = block*IDINDEX_BLOCK;
+  long end = start + IDINDEX_BLOCK < ix->numStars ? start + IDINDEX_BLOCK : ix->numStars;
+  while (start < end)
+    {
+      long mid = (end-start)/2 + start;
+      if (ix->ids[mid].sourceID < sourceID)
+        start = mid+1;
+      else
+        end = mid;
+    }
+  return start < ix->numStars && ix->ids[start].sourceID == sourceID ? &ix->ids[start] : NULL;
+}
+
+const IDElement* idindex_find(const idindex *ix, long sourceID)
+{
+  return searchBlock(ix, findBlock(ix, sourceID), sourceID);
+}
+
+// The block of each id is found FIND_AHEAD ids before it is searched, and its middle record is prefetched
+// then. Sorted ids often fall into the block of the one before, which is checked before the top tree.
+void idindex_findsorted(const idindex *ix, const long ids[], long n, const IDElement *found[])
+{
+  if (ix->numStars == 0)
+    {
+      for (long i = 0; i < n; i++)
+        found[i] = NULL;
+      return;
+    }
+
+  long blocks[FIND_AHEAD];
+  long last = -1;
+  for (long i = 0; i < n + FIND_AHEAD; i++)
+    {
+      long j = i - FIND_AHEAD;
+      if (j >= 0)
+        found[j] = searchBlock(ix, blocks[j % FIND_AHEAD], ids[j]);
+
+      if (i < n)
+        {
+          long id = ids[i];
+          bool same = last >= 0 && ix->fences[last] < id && (last+1 == ix->numBlocks || id <= ix->fences[last+1]);
+          if (!same)
+            last = findBlock(ix, id);
+          blocks[i % FIND_AHEAD] = last;
+          long mid = last*IDINDEX_BLOCK + IDINDEX_BLOCK/2;
+          IDX_PREFETCH(&ix->ids[mid < ix->numStars ? mid : ix->numStars-1]);
+        }
+    }
+}
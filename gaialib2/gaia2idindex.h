@@ -0,0 +1,66 @@
+#ifndef GAIA2_IDINDEX_H__
+#define GAIA2_IDINDEX_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "gaia2idsort.h"
+
+// The numeric ID index (IDIndex/ids) is a single file: an idindexheader padded to IDINDEX_DATAOFFSET, the
+// numStars IDElement records sorted by the value of sourceID, and a static search tree over them so a lookup
+// compares integers and touches few pages. It replaces the nine IDSTSort files that are split by the first
+// digit and sorted as strings. See DataPreparation/gaia2idnumsort.c
+//
+// The records are cut into blocks of IDINDEX_BLOCK and the first sourceID of each block is a fence key. The
+// fences are cut into fence pages of IDINDEX_FENCEPAGE keys (one 4 kB page), and the first key of each fence
+// page goes into the top tree, stored in Eytzinger (breadth first) order and read into memory at open time.
+// A lookup is a search of the top tree in memory, then one fence page and one block of the mapping.
+#define IDINDEX_MAGIC "GAIA2IDX"
+#define IDINDEX_VERSION 2
+
+#define IDINDEX_DATAOFFSET 4096
+#define IDINDEX_BLOCK 128
+#define IDINDEX_FENCEPAGE 512
+
+typedef struct
+{
+  char magic[8];
+  int version;
+  int recordSize;    // sizeof(IDElement)
+  long numStars;
+  int blockSize;     // IDINDEX_BLOCK
+  int fencePage;     // IDINDEX_FENCEPAGE
+  long numBlocks;    // fence keys
+  long numTop;       // fence pages, that is keys of the top tree
+  long fenceOffset;  // byte offset of the fence keys (long)
+  long topOffset;    // byte offset of the top tree: numTop+1 keys (long, the first one unused) in Eytzinger
+                     // order, then numTop+1 fence page numbers (long) in the same order
+} idindexheader;
+
+// the numeric ID index mapped into memory
+typedef struct
+{
+  void *map;
+  size_t size;
+  const IDElement *ids;   // sorted by sourceID
+  long numStars;
+  const long *fences;     // first sourceID of each block
+  long numBlocks;
+  long *top;              // copy of the top tree, 1 based
+  long *topPage;
+  long numTop;
+} idindex;
+
+// maps the numeric ID index. Returns false if it does not exist or is not a valid index
+bool idindex_open(idindex *ix);
+
+// unmaps an index opened by idindex_open
+void idindex_close(idindex *ix);
+
+// looks up a source_id, returns its record or NULL if it is not in the index
+const IDElement* idindex_find(const idindex *ix, long sourceID);
+
+// looks up n source ids sorted in increasing order: found[i] is set to the record of ids[i] or NULL
+void idindex_findsorted(const idindex *ix, const long ids[], long n, const IDElement *found[]);
+
+#endif
@@ -0,0 +1,215 @@
+#include <math.h>
+
+#include "gaia2kernel.h"
+#include "astromath.h"
+#include "mmath.h"
+
+// BLOCK KERNELS:
+// The position tests run over arrays of ra and dec so the loops vectorize. The sines and cosines come
+// from the branch free sincos below instead of libm, which the compiler cannot vectorize. On x86-64 the
+// kernels are built for AVX-512, AVX2 and plain x86-64 and the loader picks the widest one the cpu
+// supports (target_clones). This file is compiled with -O3 for the vectorizer.
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(__clang__)
+#define KERNEL_DISPATCH __attribute__((target_clones("avx512f","avx2","default")))
+#else
+#define KERNEL_DISPATCH
+#endif
+
+// the helpers have to be inlined into the loops for them to vectorize
+#if defined(__GNUC__)
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+#else
+#define KERNEL_INLINE static inline
+#endif
+
+// pi/2 split in three parts for the argument reduction (cephes)
+#define PIO2_1 1.57079625129699707031E0
+#define PIO2_2 7.54978941586159635335E-8
+#define PIO2_3 5.39030285815811905290E-15
+
+// sine and cosine of x [rad], |x| up to a few turns. The argument is reduced to [-pi/4, pi/4] and the
+// cephes polynomials are used, the error is about one ulp
+KERNEL_INLINE void kern_sincos(double x, double *s, double *c)
+{
+  double q = floor(x*(2.0/PI) + 0.5);
+  double quadrant = q - 4.0*floor(q*0.25);  // kept in double, the conversion to an integer does not vectorize
+  double r = ((x - q*PIO2_1) - q*PIO2_2) - q*PIO2_3;
+  double z = r*r;
+
+  double sr = r + r*z*((((((1.58962301576546568060E-10*z - 2.50507477628578072866E-8)*z
+                           + 2.75573136213857245213E-6)*z - 1.98412698295895385996E-4)*z
+                         + 8.33333333332211858878E-3)*z) - 1.66666666666666307295E-1);
+  double cr = 1.0 - 0.5*z + z*z*(((((-1.13585365213876817300E-11*z + 2.08757008419747316778E-9)*z
+                                    - 2.75573141792967388112E-7)*z + 2.48015872888517045348E-5)*z
+                                  - 1.38888888888730564116E-3)*z + 4.16666666666665929218E-2);
+
+  // quadrants 0 ... 3: sin is sr, cr, -sr, -cr and cos is cr, -sr, -cr, sr
+  bool swap = quadrant == 1.0 || quadrant == 3.0;
+  double sv = swap ? cr : sr;
+  double cv = swap ? sr : cr;
+  *s = quadrant >= 2.0 ? -sv : sv;
+  *c = quadrant == 1.0 || quadrant == 2.0 ? -cv : cv;
+}
+
+// The gnomonic projection puts a star at distance tan(c) from the center, c being the angle between the
+// two. It is within the radius R [rad] if tan(c) <= R, that is cos(c) >= 1/sqrt(1+R^2), and cos(c) is the
+// dot product of the unit vectors of the star and the center.
+KERNEL_DISPATCH
+void kern_cone(const double ra[], const double dec[], int n, double centRA, double centDec, double radius, bool pass[])
+{
+  double sinra, cosra, sindec, cosdec;
+  kern_sincos(DEG2RAD(centRA), &sinra, &cosra);
+  kern_sincos(DEG2RAD(centDec), &sindec, &cosdec);
+  const double cx = cosdec*cosra;
+  const double cy = cosdec*sinra;
+  const double cz = sindec;
+
+  const double tanr = radius/RAD2DEG(1.0);
+  const double mincos = 1.0/sqrt(1.0 + tanr*tanr);
+
+  for (int i = 0; i < n; i++)
+    {
+      double sa, ca, sd, cd;
+      kern_sincos(DEG2RAD(ra[i]), &sa, &ca);
+      kern_sincos(DEG2RAD(dec[i]), &sd, &cd);
+      double dot = cd*ca*cx + cd*sa*cy + sd*cz;
+      pass[i] = dot >= mincos;
+    }
+}
+
+// gnomonic projection [deg] of a star around the center given by its ra [rad] and the sine and cosine of its dec.
+// Same formula as astr_gnomonic, with xi = eta = 0 where the projection is undefined
+KERNEL_INLINE void kern_project(double ra, double dec, double rac, double sindecc, double cosdecc, double *xi, double *eta)
+{
+  double sindra, cosdra, sindec, cosdec;
+  kern_sincos(DEG2RAD(ra) - rac, &sindra, &cosdra);
+  kern_sincos(DEG2RAD(dec), &sindec, &cosdec);
+  double cosc = sindecc*sindec + cosdecc*cosdec*cosdra;
+  double inv = IS_ZERO(cosc) ? 0.0 : RAD2DEG(1.0)/cosc;
+  *xi = cosdec*sindra*inv;
+  *eta = (cosdecc*sindec - sindecc*cosdec*cosdra)*inv;
+}
+
+KERNEL_DISPATCH
+void kern_gnomonic(const double ra[], const double dec[], int n, double centRA, double centDec, double xi[], double eta[])
+{
+  double sindecc, cosdecc;
+  kern_sincos(DEG2RAD(centDec), &sindecc, &cosdecc);
+  const double rac = DEG2RAD(centRA);
+
+  for (int i = 0; i < n; i++)
+    kern_project(ra[i], dec[i], rac, sindecc, cosdecc, &xi[i], &eta[i]);
+}
+
+KERNEL_DISPATCH
+void kern_box(const double ra[], const double dec[], int n, double centRA, double centDec, double half_size, bool pass[])
+{
+  if (half_size <= 0)
+    {
+      for (int i = 0; i < n; i++)
+        pass[i] = true;
+      return;
+    }
+
+  double sindecc, cosdecc;
+  kern_sincos(DEG2RAD(centDec), &sindecc, &cosdecc);
+  const double rac = DEG2RAD(centRA);
+
+  for (int i = 0; i < n; i++)
+    {
+      double xi, eta;
+      kern_project(ra[i], dec[i], rac, sindecc, cosdecc, &xi, &eta);
+      pass[i] = (fabs(xi) <= half_size) & (fabs(eta) <= half_size);
+    }
+}
+
+// pi to full precision for the arctangent, PI of mmath.h is shorter
+#define KERN_PI 3.14159265358979323846
+
+// arctangent of y/x [rad] in (-pi, pi], as atan2. The ratio of the smaller to the larger of |x| and |y|
+// goes through the cephes rational approximation of atan on [0, 1], the quadrant is restored after
+KERNEL_INLINE double kern_atan2(double y, double x)
+{
+  double ax = fabs(x), ay = fabs(y);
+  double big = ax > ay ? ax : ay;
+  double small = ax > ay ? ay : ax;
+  double t = big > 0 ? small/big : 0.0;
+
+  // atan(t) = pi/4 + atan((t-1)/(t+1)) above 0.66
+  bool mid = t > 0.66;
+  double u = mid ? (t - 1.0)/(t + 1.0) : t;
+  double z = u*u;
+  double p = (((-8.750608600031904122785E-1*z - 1.615753718733365076637E1)*z - 7.500855792314704667340E1)*z
+              - 1.228866684490136173410E2)*z - 6.485021904942025371773E1;
+  double q = ((((z + 2.485846490142306297962E1)*z + 1.650270098316988542046E2)*z + 4.328810604912902668951E2)*z
+              + 4.853903996359136964868E2)*z + 1.945506571482613964425E2;
+  double a = u + u*z*p/q;
+  a = mid ? a + (KERN_PI/4 + 0.5*6.123233995736765886130E-17) : a;
+
+  a = ay > ax ? KERN_PI/2 - a : a;
+  a = x < 0 ? KERN_PI - a : a;
+  return y < 0 ? -a : a;
+}
+
+// proper motion of a star over tdiff years, as pmotion_apply: no motion in ra at the poles and dec
+// reflected at +-90
+KERNEL_INLINE void kern_pm(double *ra, double *dec, double pmra, double pmdec, double tdiff)
+{
+  double d0 = *dec;
+  double d1 = d0 + MAS2DEG( pmdec*tdiff );
+  bool pole0 = fabs(fabs(d0) - 90.0) < REAL_EPSILON;
+  bool pole1 = fabs(fabs(d1) - 90.0) < REAL_EPSILON;
+
+  double s, c;
+  kern_sincos(DEG2RAD(pole0 ? d1 : d0), &s, &c);
+  double r = *ra + MAS2DEG( pmra*tdiff/c );
+  double d = d1;
+  bool still = pole0 & pole1;
+  r = still ? *ra : r;
+  d = still ? d0 : d;
+
+  // dmodRA and dmodDec
+  r = r < 0 ? r + 360.0 : r;
+  r = r >= 360.0 ? r - 360.0 : r;
+  r = (fabs(r) < REAL_EPSILON) | (fabs(r - 360.0) < REAL_EPSILON) ? 0.0 : r;
+  d = d > 90.0 ? 180.0 - d : d;
+  d = d < -90.0 ? -180.0 - d : d;
+
+  *ra = r;
+  *dec = d;
+}
+
+// rotates the position of a star by the matrix P, stored by rows
+KERNEL_INLINE void kern_rotate(double *ra, double *dec, const double P[9])
+{
+  double sa, ca, sd, cd;
+  kern_sincos(DEG2RAD(*ra), &sa, &ca);
+  kern_sincos(DEG2RAD(*dec), &sd, &cd);
+  double x = cd*ca, y = cd*sa, z = sd;
+
+  double px = P[0]*x + P[1]*y + P[2]*z;
+  double py = P[3]*x + P[4]*y + P[5]*z;
+  double pz = P[6]*x + P[7]*y + P[8]*z;
+
+  double r = RAD2DEG( kern_atan2(py, px) );
+  r = r < 0 ? r + 360.0 : r;
+  *ra = (fabs(r) < REAL_EPSILON) | (fabs(r - 360.0) < REAL_EPSILON) ? 0.0 : r;
+  *dec = RAD2DEG( kern_atan2(pz, sqrt(px*px + py*py)) );
+}
+
+// the proper motion and the rotation are two passes over the block, each of them vectorizes and the block is
+// still in the cache for the second one
+KERNEL_DISPATCH
+void kern_propagate(double ra[], double dec[], const double pmra[], const double pmdec[], int n, double tdiff, const double P[9])
+{
+  if (pmra != NULL)
+    for (int i = 0; i < n; i++)
+      kern_pm(&ra[i], &dec[i], pmra[i], pmdec[i], tdiff);
+
+  if (P != NULL)
+    {
+      for (int i = 0; i < n; i++)
+        kern_rotate(&ra[i], &dec[i], P);
+    }
+}
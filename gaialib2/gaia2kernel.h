@@ -0,0 +1,24 @@
+#ifndef GAIA2_KERNEL_H__
+#define GAIA2_KERNEL_H__
+
+#include <stdbool.h>
+
+// Position tests that work on blocks of stars (see gaia2kernel.c). ra and dec are arrays of n
+// positions in degrees, pass[i] is set to whether star i is within the field.
+
+// cone test: star i passes if its gnomonic projection around centRA, centDec is within radius [deg]
+void kern_cone(const double ra[], const double dec[], int n, double centRA, double centDec, double radius, bool pass[]);
+
+// gnomonic projection [deg] of the stars around centRA, centDec into xi and eta, as astr_rgnomonic
+void kern_gnomonic(const double ra[], const double dec[], int n, double centRA, double centDec, double xi[], double eta[]);
+
+// box test: star i passes if both coordinates of its gnomonic projection are within half_size [deg], or if
+// half_size is not positive
+void kern_box(const double ra[], const double dec[], int n, double centRA, double centDec, double half_size, bool pass[]);
+
+// moves the stars by their proper motion [mas/yr] over tdiff years and then turns them by the rotation matrix P
+// (stored by rows), as pmotion_precess2000 with the matrix of pmotion_precessmatrix2000. The proper motion is
+// skipped if pmra is NULL and the rotation if P is NULL
+void kern_propagate(double ra[], double dec[], const double pmra[], const double pmdec[], int n, double tdiff, const double P[9]);
+
+#endif
@@ -11,8 +11,10 @@
 #include "utils.h"
 #include "myargs.h"
 #include "gaia2ret.h"
+#include "gaia2cat.h"
+#include "gaia2zone.h"
+#include "gaia2catalog.h"
 #include "astrio.h"
-#include "sllist.h"
 #include "astrometry.h"
 #include "gaiaPrint.h"
 
@@ -20,6 +22,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <ctype.h>
+#include <limits.h>
 
 
 //*********************cmd-line arguments*********************
@@ -29,7 +33,7 @@
 //includes option flag to request based on input of gaia id, hat id, or 2 mass id
 
 enum {
-    //arg_catpath,
+    arg_catpath,
     arg_header,
     //arg_outphot,
     //arg_estphot,
@@ -39,6 +43,11 @@ enum {
     arg_idfile,
     arg_precess,
     arg_pm,
+    arg_threads,
+    arg_layout,
+    arg_idlookup,
+    arg_refepoch,
+    arg_format,
     arg_cmdline
 };
 
@@ -52,14 +61,19 @@ myoptlong longoptions[] =
     { "circ",           no_argument,        'c'         },
     { "id",             required_argument,  'g'         },
     { "idtype",         required_argument,   arg_idtype },
-    //{ "cat",            required_argument,  arg_catpath },
-    //{ "catalog",        required_argument,  arg_catpath },//
+    { "cat",            required_argument,  arg_catpath },
+    { "catalog",        required_argument,  arg_catpath },
     { "header",         no_argument,        arg_header  },
     { "extra",          no_argument,        arg_extra   },
     { "idrequest",     required_argument,  arg_idrequest  },
     { "idfile",         required_argument,  arg_idfile  },
     { "precess",        required_argument,  arg_precess },
     { "pm",             optional_argument,  arg_pm      },
+    { "threads",        required_argument,  arg_threads },
+    { "layout",         required_argument,  arg_layout },
+    { "idlookup",       required_argument,  arg_idlookup },
+    { "refepoch",       required_argument,  arg_refepoch },
+    { "format",         required_argument,  arg_format },
     { "cmdline",        no_argument,        arg_cmdline },
     { "out",            required_argument,  'o'         },
     { "version",        no_argument,        'v'         },
@@ -67,8 +81,30 @@ myoptlong longoptions[] =
     { 0, 0, 0 }
 };
 
+// output of a streamed area search, opened when the first star arrives
+typedef struct
+{
+    const char*     outfile;
+    FILE*           os;
+    bool            print_header;
+    bool            print_cmdline;
+    int             argc;
+    char**          argv;
+    starprinter     printer;
+} streamout;
+
+// Gaia source ids of an ID query in the order they were given, grown by doubling up to INT_MAX ids
+typedef struct
+{
+    long*           ids;
+    long            count;
+    long            size;
+} idlist;
+
 // local functions
-static int     add_star_to_list( sllist** ids, const char* id, bool isfile, IDType inputIDType);
+static void    add_star_to_list( idlist* ids, const char* id, bool isfile, IDType inputIDType);
+static FILE*   open_output( const char* outfile, bool print_header, bool print_cmdline, int argc, char** argv, starprinter* printer );
+static bool    print_star( const gaiastar* star, void* args );
 static void     usage();
 static void     help();
 static void     version();
@@ -83,7 +119,7 @@ int main(int argc, char** argv)
     double size               = 0;
     bool is_circular        = false;
     const char* outfile     = NULL;
-    sllist* ids             = NULL;
+    idlist ids              = { NULL, 0, 0 };
     bool print_header       = false;
     bool print_extra        = false;
     IDType inputIDType      = GAIA;
@@ -95,7 +131,10 @@ int main(int argc, char** argv)
     bool print_cmdline      = false;
     const char* gID               = NULL;
     const char* idFile            = NULL;
-    int idcount = 0;//number of id stars added to list
+    const char* catpath           = NULL;
+    zonelayout layout       = ZONE_ROWS;
+    bool refepoch_set       = false;
+    outformat format        = FORMAT_TEXT;
     int opt;
 
     while ((opt = mygetopt(argc, argv, "r:d:p:s:cg:o:vh", longoptions)) != NO_MORE_OPTIONS)
@@ -205,6 +244,81 @@ int main(int argc, char** argv)
 	            }
 	            break;
 
+	        case arg_threads:   // --threads
+	            {
+	                int nthreads;
+	                if ( !mystr2i( myoptarg, &nthreads ) || nthreads < 1 ) {
+	                    err_ret(
+	                        EXIT_FAILURE, "%s: invalid number of threads %s",
+	                        progname, myoptarg
+	                    );
+	                }
+	                gaia2cat_setthreads( nthreads );
+	            }
+	            break;
+
+	        case arg_layout:    // --layout
+	            {
+	                int l = 0;
+	                while ( l < ZONE_NLAYOUTS && strcmp( myoptarg, zone_layoutnames[l] ) )
+	                    l++;
+	                if ( l == ZONE_NLAYOUTS ) {
+	                    err_ret(
+	                        EXIT_FAILURE, "%s: invalid zone file layout %s",
+	                        progname, myoptarg
+	                    );
+	                }
+	                layout = (zonelayout)l;
+	            }
+	            zone_setlayout( layout );
+	            break;
+
+	        case arg_idlookup:  // --idlookup
+	            if ( !strcmp( myoptarg, "index" ) )
+	                gaia2ret_setidlookup( IDLOOKUP_INDEX );
+	            else if ( !strcmp( myoptarg, "healpix" ) )
+	                gaia2ret_setidlookup( IDLOOKUP_HEALPIX );
+	            else {
+	                err_ret(
+	                    EXIT_FAILURE, "%s: invalid ID lookup %s",
+	                    progname, myoptarg
+	                );
+	            }
+	            break;
+
+	        case arg_refepoch:  // --refepoch
+	            {
+	                real refepoch;
+	                if ( !mystr2d( myoptarg, &refepoch ) ) {
+	                    err_ret(
+	                        EXIT_FAILURE, "%s: invalid reference epoch %s",
+	                        progname, myoptarg
+	                    );
+	                }
+	                gaia2_setrefepoch( refepoch );
+	                refepoch_set = true;
+	            }
+	            break;
+
+	        case arg_catpath:   // --cat
+	            catpath = myoptarg;
+	            break;
+
+	        case arg_format:    // --format
+	            if ( !strcmp( myoptarg, "text" ) )
+	                format = FORMAT_TEXT;
+	            else if ( !strcmp( myoptarg, "fits" ) )
+	                format = FORMAT_FITS;
+	            else if ( !strcmp( myoptarg, "raw" ) )
+	                format = FORMAT_RAW;
+	            else {
+	                err_ret(
+	                    EXIT_FAILURE, "%s: invalid output format %s",
+	                    progname, myoptarg
+	                );
+	            }
+	            break;
+
 	        case arg_cmdline:   // --cmdline
 	            print_cmdline = true;
 	            break;
@@ -220,11 +334,30 @@ int main(int argc, char** argv)
         }
     }
 
+    // the catalog is opened before the first query, its manifest gives the epoch unless --refepoch did
+    if ( catpath != NULL && !catalog_open( catpath ) ) {
+        err_ret(
+            EXIT_FAILURE, "%s: cannot open the catalog %s",
+            progname, catpath
+        );
+    }
+    if ( catalog_get()->zonePaths[layout] == NULL ) {
+        err_ret(
+            EXIT_FAILURE, "%s: the catalog %s was not built with the layout %s",
+            progname, catalog_get()->path, zone_layoutnames[layout]
+        );
+    }
+    if ( !refepoch_set )
+        gaia2_setrefepoch( catalog_get()->refepoch );
+
+    // the photometry block is only read from the zone files if it is printed
+    zone_setextra( print_extra );
+
     // collect ID information from arguments 'g' and arg_idfile
     if (gID != NULL)
-        idcount = add_star_to_list( &ids, gID, false, inputIDType );
+        add_star_to_list( &ids, gID, false, inputIDType );
     if (idFile != NULL)
-        idcount = add_star_to_list( &ids, idFile, true, inputIDType );
+        add_star_to_list( &ids, idFile, true, inputIDType );
 
     // sanity check on cmd-line arguments
     if (    ( cent_ra_set && !cent_dec_set )
@@ -243,7 +376,7 @@ int main(int argc, char** argv)
 	//*********************Collect Input from Command Line*********************
     if ( myoptind == argc ) {
         // no more command line arguments
-        if ( ids == NULL ) {
+        if ( ids.count == 0 ) {
             if (!cent_ra_set) {
                 if ( size > 0 ) {
                     err_print_msg( "nothing to search for" );
@@ -286,169 +419,158 @@ int main(int argc, char** argv)
 
     if ( cent_ra_set ) {
       const double* pJD = epoch ? &JD : NULL;
-      int count;
-      if ( !is_circular ) {
-	// read square count                                                                                                                                                                                                                   
-	count = starPosCount(center.RA, center.Dec, false, size, pJD);
-      }
-      else {
-	// read circle count                                                                                                                                                                                                                 
-	count = starPosCount(center.RA, center.Dec, true, size, pJD);
-      }
-      gaiastar *stars;
-      stars=malloc(count*sizeof(gaiastar));
-
-        if ( !is_circular ) {
-            // read square
-	  starPosSearch(center.RA, center.Dec, false, size, pJD,stars);
-        }
-        else {
-            // read circle
-	  starPosSearch(center.RA, center.Dec, true, size, pJD,stars);
-        }
+      // stream the stars to the output zone by zone as they are found, nothing is stored
+      streamout out = {
+          outfile, NULL, print_header, print_cmdline, argc, argv,
+          { NULL, print_extra, specify_idOut, format, NULL, 0, 0, 0, NULL, 0 }
+      };
+      int count = starPosWalk(center.RA, center.Dec, is_circular, size, pJD, equinox ? &JDequinox : NULL, print_star, &out);
+      gaiastar_printend( &out.printer );
 
         if (count==0 ) {
             err_print_msg( "no star found" );
             exit( EXIT_FAILURE );
         }
-
-        if ( outfile ) {
-            os = fopen( outfile, "w" );
-            if ( !os ) {
-                err_ret( 11, "%s: cannot open file %s", progname, outfile );
-            }
-        }
-
-        if ( equinox ) {
-	  gaia2_precesslist( stars, JDequinox,count );
-        }
-
-        if ( !os ) {
-            os = stdout;
-        }
-
-        if ( print_header ) {
-            gaiastar_printheader( os, print_extra, specify_idOut);
-        }
-
-        if ( print_cmdline ) {
-            fputs( "# ", os );
-            myargs_print_cmdline( os, argc, argv );
-        }
-
-        if(specify_idOut==GAIA)
-	  gaiastar_printlist(os, stars,print_extra,count);
-        else
-        {
-	  sllist* altIDs = starListToIDs(stars,specify_idOut,count);
-            gaiastar_printlist_alternateID(os, stars, print_extra, altIDs, specify_idOut,count);
-        }
+        os = out.os;
     }
     else {
         const double* pJD = epoch ? &JD : NULL;
         // get stars based on their IDs
         gaiastar *stars;
-	stars = malloc(idcount*sizeof(gaiastar));
-	  starsfromID(ids, pJD,stars);
-
-	  if (idcount==0) {
+        if ( ids.count == 0 ) {
             err_print_msg( "no star found" );
             exit( EXIT_FAILURE );
         }
 
-        if ( outfile ) {
-            os = fopen( outfile, "w" );
-            if ( !os ) {
-                err_ret( 11, "%s: cannot open file %s", progname, outfile );
-            }
+        stars = malloc( ids.count*sizeof(gaiastar) );
+        if ( stars == NULL ) {
+            err_ret_failure( "cannot allocate memory for %ld stars", ids.count );
         }
+        starsfromID( ids.ids, ids.count, NULL, stars );
+        // add_id keeps the count within int
+        int idcount = (int)ids.count;
 
-        if ( equinox ) {
-	  gaia2_precesslist( stars, JDequinox ,idcount);
-        }
+        // proper motion and precession in one pass over the list
+        gaia2_propagatelist( stars, idcount, pJD, equinox ? &JDequinox : NULL );
 
-        if ( !os ) {
-            os = stdout;
-        }
+        starprinter printer = { NULL, print_extra, specify_idOut, format, NULL, 0, 0, 0, NULL, 0 };
+        os = open_output( outfile, print_header, print_cmdline, argc, argv, &printer );
+        gaiastar_printstars( &printer, stars, idcount );
+        gaiastar_printend( &printer );
+    }
 
-        if ( print_header ) {
-	  gaiastar_printheader( os, print_extra, specify_idOut);
-        }
+    if ( outfile ) {
+        fclose( os );
+    }
 
-        if ( print_cmdline ) {
-            fputs( "# ", os );
-            myargs_print_cmdline( os, argc, argv );
-        }
 
-        if(specify_idOut==GAIA)
-	  gaiastar_printlist(os, stars,print_extra,idcount);
-        else
-        {
-	  sllist* altIDs = starListToIDs(stars,specify_idOut,idcount);
-	    gaiastar_printlist_alternateID(os, stars, print_extra, altIDs, specify_idOut,idcount);
+	exit(EXIT_SUCCESS);
+}
+
+// opens the output file (or stdout) and starts the output of the printer, the text format gets the header and
+// command line if requested
+FILE* open_output( const char* outfile, bool print_header, bool print_cmdline, int argc, char** argv, starprinter* printer )
+{
+    FILE* os = stdout;
+
+    if ( outfile ) {
+        os = fopen( outfile, "w" );
+        if ( !os ) {
+            err_ret( 11, "%s: cannot open file %s", progname, outfile );
         }
     }
 
-    if ( outfile ) {
-        fclose( os );
+    if ( print_header && printer->format == FORMAT_TEXT ) {
+        gaiastar_printheader( os, printer->extra, printer->type );
     }
 
+    if ( print_cmdline && printer->format == FORMAT_TEXT ) {
+        fputs( "# ", os );
+        myargs_print_cmdline( os, argc, argv );
+    }
 
-	exit(EXIT_SUCCESS);
+    gaiastar_printbegin( printer, os );
+    return os;
+}
+
+// visitor of the area search: opens the output for the first star, then prints each star (already precessed by the scan)
+bool print_star( const gaiastar* star, void* args )
+{
+    streamout* out = (streamout*)args;
+
+    if ( !out->os ) {
+        out->os = open_output(
+            out->outfile, out->print_header, out->print_cmdline, out->argc, out->argv, &out->printer
+        );
+    }
+
+    return gaiastar_printvisit( star, &out->printer );
 }
 
-// method to change formatted input HAT or 2MASS ID to a long form
-local int toLongID(const char* id,IDType inputIDType,char* longID)
+// method to change formatted input HAT (GGG-NNNNNNN) or 2MASS (HHMMSSss+DDMMSSs) ID of len characters to a long
+// form, 0 if it is too short
+local long toLongID(const char* id,size_t len,IDType inputIDType)
 {
+  char longID[20];
   if(inputIDType==HAT)
     {
-      longID[strlen(id)-4]=id[0];
-      longID[strlen(id)-3]=id[1];
-      longID[strlen(id)-2]=id[2];
-      unsigned int i;
-      for(i = 4; i < strlen(id);i++)
-	{
-	  longID[i-4]=id[i];
-	}
-      longID[i-1]='\0';
-      printf("%s %s\n",id,longID);
-      return 0;
-
+      if (len < 5 || len > sizeof(longID))
+        return 0;
+      // the number, then the field
+      memcpy(longID,id+4,len-4);
+      memcpy(longID+len-4,id,3);
+      longID[len-1]='\0';
     }
   else if(inputIDType==TMASS)
     {
-      if(id[8]=='+')
-	longID[0]='1';
-      else
-	longID[0]='2';
-
-      longID[1]=id[0];
-      longID[2]=id[1];
-      longID[3]=id[2];
-      longID[4]=id[3];
-      longID[5]=id[4];
-      longID[6]=id[5];
-      longID[7]=id[6];
-      longID[8]=id[7];
-      longID[9]=id[9];
-      longID[10]=id[10];
-      longID[11]=id[11];
-      longID[12]=id[12];
-      longID[13]=id[13];
-      longID[14]=id[14];
-      longID[15]=id[15];
+      if (len < 16)
+        return 0;
+      // the sign of the dec as 1 (+) or 2 (-), then the digits of ra and dec
+      longID[0]= id[8]=='+' ? '1' : '2';
+      memcpy(longID+1,id,8);
+      memcpy(longID+9,id+9,7);
       longID[16]='\0';
-      return 0;
     }
+  else
+    return 0;
 
-  return 0;
+  return strtol(longID,NULL,10);
 }
 
-int  add_star_to_list( sllist** ids, const char* id, bool isfile, IDType inputIDType)
+// adds the ID at the start of text (after blanks, up to the next blank) as a Gaia source id. Returns false if
+// there is no ID
+local bool add_id( idlist* ids, const char* text, IDType inputIDType )
+{
+    const char* id = empty_string( text );
+    if ( !id ) {
+        return false;
+    }
+    size_t len = 0;
+    while ( id[len] && !isspace( (unsigned char)id[len] ) ) {
+        len++;
+    }
+
+    long gaiaID = inputIDType == GAIA ? strtol( id, NULL, 10 ) : toGaiaID( toLongID( id, len, inputIDType ), inputIDType );
+    // the star lists of the lookup and the output are counted with int
+    if ( ids->count == INT_MAX ) {
+        err_ret_failure( "too many IDs, a query can look up at most %d", INT_MAX );
+    }
+    if ( ids->count == ids->size ) {
+        ids->size = ids->size ? 2*ids->size : 1024;
+        ids->ids = realloc( ids->ids, ids->size*sizeof(long) );
+        if ( !ids->ids ) {
+            err_ret_failure( "cannot allocate memory for %ld IDs", ids->size );
+        }
+    }
+    ids->ids[ids->count++] = gaiaID;
+    return true;
+}
+
+// adds an ID, or the IDs of a file (one per line, # starts a comment) if isfile is set or the ID starts with @
+void add_star_to_list( idlist* ids, const char* id, bool isfile, IDType inputIDType)
 {
-  int idcount=0;
     if ( !id || !*id ) {
-        return idcount;
+        return;
     }
 
     if ( isfile || *id == '@' ) {
@@ -456,63 +578,26 @@ int  add_star_to_list( sllist** ids, const char* id, bool isfile, IDType inputID
         FILE* idfile = fopen( filename, "r" );
         if ( !idfile ) {
             err_print_msg( "cannot open input ID file %s", filename );
-            return idcount;
+            return;
         }
 
-        char* line = malloc( MAX_LINE * sizeof *line );
+        char* line = NULL;
         size_t len = 0;
         while ( getline( &line, &len, idfile ) > 0 ) {
             char* comment = strchr( line, '#' );
             if ( comment ) {
                 *comment = '\0';
             }
-	    char idBuffer[30];
-	    if(inputIDType==GAIA)
-	      {
-		char* idstr = toGaiaID(( char* )empty_string( line ),inputIDType,idBuffer);
-		if ( idstr && *( idstr = trim_right( idstr ) ) ) {
-		  slappend( ids, idstr, strlen( idstr ) + 1 );
-		  idcount++;
-		}
-	      }
-	    else
-	      {
-		char longid[20];
-		//            char* idstr = ( char* )empty_string( line );
-		toLongID(( char* )empty_string( line ),inputIDType,longid);
-		char* idstr = toGaiaID(longid,inputIDType,idBuffer);
-		if ( idstr && *( idstr = trim_right( idstr ) ) ) {
-		  slappend( ids, idstr, strlen( idstr ) + 1 );
-		  idcount++;
-		}
-	      }
-	}
+            add_id( ids, line, inputIDType );
+        }
 
         free( line );
         fclose( idfile );
     }
     else {
-      char idBuffer[30];
-      if(inputIDType==GAIA)
-	{
-	  char *idstr = toGaiaID(id,inputIDType,idBuffer);
-	  slappend( ids, idstr, strlen( idstr ) + 1 );
-	}
-      else
-	{
-	  char longid[20];
-
-	  toLongID(id,inputIDType,longid);
-
-	  char *idstr = toGaiaID(longid,inputIDType,idBuffer);
-	  slappend( ids, idstr, strlen( idstr ) + 1 );
-	}
-      
-
-	idcount++;
+        add_id( ids, id, inputIDType );
     }
-    return idcount;
- }
+}
 
 void usage()
 {
@@ -534,14 +619,19 @@ void usage()
 " --circ|-c             : circular field instead of box",
 " --id|-g <ID>          : retrieve source <ID> from catalogue",
 " --idtype              : GAIA, HAT, TMASS, the type of ID that the input is given in",
-//" --cat <path>          : top-level catalog path",
+" --cat <path>          : top-level catalog path, "GAIA2_CATPATH" by default",
 " --header              : print header",
 " --extra               : print extra values including phot information and luminosity/radius",
 " --idrequest           : GAIA, HAT, TMASS, the type of ID that the output gives",
 " --idfile <path>       : read IDs (see option -g) from file",
 " --precess <equinox>   : apply correction for precession for a given equinox",
 " --pm <epoch>          : apply correction for proper motions. Epoch is in years",
+" --threads <n>         : scan zone files with <n> threads",
+" --layout <layout>     : rows (sortedBin), columns (sortedCol) or split (sortedAst and sortedPhot), layout of the zone files",
+" --idlookup <lookup>   : index (ID index) or healpix (search near the HEALPix pixel of the source_id), how IDs are found",
+" --refepoch <epoch>    : epoch of the catalog positions in years, given by the catalog manifest (2015.5 without one)",
 " --out|-o <file>       : output file",
+" --format <format>     : text, fits (FITS binary table, needs --out) or raw (packed records, see gaia2table.h)",
 " --cmdline             : prints command line first",
 " --version|-v          : prints out version",
 " --help|-h             : print help screen",
@@ -572,14 +662,19 @@ void help()
 " --circ|-c             : circular field instead of box",
 " --id|-g <ID>          : retrieve source <ID> from catalogue",
 " --idtype              : GAIA, HAT, TMASS, the type of ID that the input is given in",
-//" --cat <path>          : top-level catalog path",
+" --cat <path>          : top-level catalog path, "GAIA2_CATPATH" by default",
 " --header              : print header",
 " --extra               : print extra values including phot information and luminosity/radius",
 " --idrequest           : GAIA, HAT, TMASS, the type of ID that the output gives",
 " --idfile <path>       : read IDs (see option -g) from file",
 " --precess <equinox>   : apply correction for precession for a given equinox",
 " --pm <epoch>          : apply correction for proper motions. Epoch is in years",
+" --threads <n>         : scan zone files with <n> threads",
+" --layout <layout>     : rows (sortedBin), columns (sortedCol) or split (sortedAst and sortedPhot), layout of the zone files",
+" --idlookup <lookup>   : index (ID index) or healpix (search near the HEALPix pixel of the source_id), how IDs are found",
+" --refepoch <epoch>    : epoch of the catalog positions in years, given by the catalog manifest (2015.5 without one)",
 " --out|-o <file>       : output file",
+" --format <format>     : text, fits (FITS binary table, needs --out) or raw (packed records, see gaia2table.h)",
 " --cmdline             : prints command line first",
 " --version|-v          : prints out version",
 " --help|-h             : print help screen",
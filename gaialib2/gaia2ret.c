@@ -2,128 +2,33 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include "astromath.h"
 #include "mmath.h"
 #include "gaia2ret.h"
 #include "astrometry.h"
 #include "gaia2cat.h"
+#include "gaia2zone.h"
+#include "gaia2catalog.h"
+#include "gaia2crossid.h"
+#include "gaia2kernel.h"
 #include "gaiastar.h"
 #include "gaia2idsort.h"
+#include "gaia2idindex.h"
 #include "mmath.h"
 #include "utils.h"
-#include "sllist.h"
-#include "pmotion.h"
 
 IDElement recurseID(long start, long end, long gaiaID, FILE *idFile);
-gaiastar getStarfromID(long gaiaID, const double *epoch);
 
-int starPosCount(double ra, double dec, bool circle, double frame_size,const double *epoch)
+// calculates the ra and dec range that has to be searched for a box (half size) or circle (radius) around ra and dec
+local void searchBounds(double ra, double dec, double frame_size, const double *epoch,
+			double *ra_min, double *ra_max, double *dec_min, double *dec_max)
 {
-  if (!circle)
-    frame_size = frame_size/2;
-
-  double ra_min = 0.0;
-  double ra_max = 0.0;
-  double dec_min = 0.0;
-  double dec_max = 0.0;
-
-  if ( frame_size > 0 ) {
-    double pm_corr = 0;
-    if ( epoch ) {
-      double tdiff = abs(*epoch - 2015.5);
-      // add another 0.1 mas/yr to PM to avoid any rounding errors                                                                                                                                                                                                        
-      pm_corr = 0.1 * ( 40000 + 1 ) * tdiff;
-      pm_corr = MAS2DEG( pm_corr );
-    }
-
-    // calculate corner coordinates                                                                                                                                                                                                                                         
-    double search_size = frame_size+pm_corr;
-
-    double ra_ll, dec_ll;     // lower left                                                                                                                                                                                                                                 
-    astr_rignomonic(
-		    -search_size, -search_size, ra, dec, &ra_ll, &dec_ll
-		    );
-
-    double ra_ul, dec_ul;     // upper left                                                                                                                                                                                                                                 
-    astr_rignomonic(
-		    -search_size, search_size, ra, dec, &ra_ul, &dec_ul
-		    );
-
-    double ra_lr, dec_lr;     // lower right                                                                                                                                                                                                                                
-    astr_rignomonic(
-		    search_size, -search_size, ra, dec, &ra_lr, &dec_lr
-		    );
-
-    double ra_ur, dec_ur;     // upper right                                                                                                                                                                                                                                
-    astr_rignomonic(
-		    search_size, search_size, ra, dec, &ra_ur, &dec_ur
-		    );
-
-    double ra_lm, dec_lm;     // lower middle                                                                                                                                                                                                                               
-    astr_rignomonic(
-		    0, -search_size, ra, dec, &ra_lm, &dec_lm
-		    );
-
-    double ra_um, dec_um;     // upper middle                                                                                                                                                                                                                               
-    astr_rignomonic(
-		    0, search_size, ra, dec, &ra_um, &dec_um
-		    );
-
-    // get min/max declinations                                                                                                                                                                                                                                             
-    dec_min = MIN( dec_ul, dec_um );
-    dec_min = MIN( dec_min, dec_ll );
-    dec_min = MIN( dec_min, dec_lm );
-
-    dec_max = MAX( dec_ll, dec_lm );
-    dec_max = MAX( dec_max, dec_um );
-    dec_max = MAX( dec_max, dec_ul );
-
-    // get min/max RA                                                                                                                                                                                                                                                       
-    ra_min = MIN( ra_ul, ra_ll );
-    ra_max = MAX( ra_ur, ra_lr );
-
-    // check if pole is in the frame                                                                                                                                                                                                                                        
-    if ( dec - search_size <= -90.0 ) {
-      dec_min = -90.0;
-      ra_min = 0.0;
-      ra_max = 360.0;
-    }
-    else if ( dec + search_size >= 90.0 ) {
-      dec_max = 90.0;
-      ra_min = 0.0;
-      ra_max = 360.0;
-    }
-  }
-  else {
-    // full sky                                                                                                                                                                                                                                                             
-    ra_min = 0;
-    ra_max = 360;
-    dec_min = -90;
-    dec_max = 90;
-  }
-
-  if (circle)
-    return posCount(ra_min,ra_max,dec_min,dec_max,test_starcirc, ra, dec, frame_size, epoch);
-  else
-    return posCount(ra_min,ra_max,dec_min,dec_max,test_star, ra, dec, frame_size, epoch);
-
-}
-// returns list of stars given size, circle or rectangular, and center ra and dec
-int starPosSearch(double ra, double dec, bool circle, double frame_size, const double *epoch,gaiastar* stars)
-{
-    if (!circle)
-        frame_size = frame_size/2;
-
-    double ra_min = 0.0;
-    double ra_max = 0.0;
-    double dec_min = 0.0;
-    double dec_max = 0.0;
-
     if ( frame_size > 0 ) {
         double pm_corr = 0;
         if ( epoch ) {
-	  double tdiff = abs(*epoch - 2015.5);
+	  double tdiff = fabs(*epoch - gaia2_refepoch());
             // add another 0.1 mas/yr to PM to avoid any rounding errors
             pm_corr = 0.1 * ( 40000 + 1 ) * tdiff;
             pm_corr = MAS2DEG( pm_corr );
@@ -163,250 +68,312 @@ int starPosSearch(double ra, double dec, bool circle, double frame_size, const d
         );
 
         // get min/max declinations
-        dec_min = MIN( dec_ul, dec_um );
-        dec_min = MIN( dec_min, dec_ll );
-        dec_min = MIN( dec_min, dec_lm );
+        *dec_min = MIN( dec_ul, dec_um );
+        *dec_min = MIN( *dec_min, dec_ll );
+        *dec_min = MIN( *dec_min, dec_lm );
 
-        dec_max = MAX( dec_ll, dec_lm );
-        dec_max = MAX( dec_max, dec_um );
-        dec_max = MAX( dec_max, dec_ul );
+        *dec_max = MAX( dec_ll, dec_lm );
+        *dec_max = MAX( *dec_max, dec_um );
+        *dec_max = MAX( *dec_max, dec_ul );
 
         // get min/max RA
-        ra_min = MIN( ra_ul, ra_ll );
-        ra_max = MAX( ra_ur, ra_lr );
+        *ra_min = MIN( ra_ul, ra_ll );
+        *ra_max = MAX( ra_ur, ra_lr );
 
         // check if pole is in the frame
         if ( dec - search_size <= -90.0 ) {
-            dec_min = -90.0;
-            ra_min = 0.0;
-            ra_max = 360.0;
+            *dec_min = -90.0;
+            *ra_min = 0.0;
+            *ra_max = 360.0;
         }
         else if ( dec + search_size >= 90.0 ) {
-            dec_max = 90.0;
-            ra_min = 0.0;
-            ra_max = 360.0;
+            *dec_max = 90.0;
+            *ra_min = 0.0;
+            *ra_max = 360.0;
         }
     }
     else {
         // full sky
-        ra_min = 0;
-        ra_max = 360;
-        dec_min = -90;
-        dec_max = 90;
+        *ra_min = 0;
+        *ra_max = 360;
+        *dec_min = -90;
+        *dec_max = 90;
     }
+}
+
+// hands the stars found to the visitor as they are read, without storing them
+int starPosWalk(double ra, double dec, bool circle, double frame_size, const double *epoch, const double *equinox, starvisitor visit, void *args)
+{
+    if (!circle)
+        frame_size = frame_size/2;
+
+    double ra_min, ra_max, dec_min, dec_max;
+    searchBounds(ra, dec, frame_size, epoch, &ra_min, &ra_max, &dec_min, &dec_max);
 
     if (circle)
-      return posQuery(ra_min,ra_max,dec_min,dec_max,test_starcirc, ra, dec, frame_size, epoch,stars);
+      return posWalk(ra_min,ra_max,dec_min,dec_max,test_starcircblock, ra, dec, frame_size, epoch,equinox,visit,args);
     else
-      return posQuery(ra_min,ra_max,dec_min,dec_max,test_star, ra, dec, frame_size, epoch,stars);
+      return posWalk(ra_min,ra_max,dec_min,dec_max,test_starblock, ra, dec, frame_size, epoch,equinox,visit,args);
 }
 
-long recurseNewID(long start, long end, long ID, FILE *idFile, IDType intype, IDType outtype);
-
-sllist* starListToIDs(gaiastar stars[], IDType outID, int count)
+// the cross-ID file kind of an ID type
+local crossidtype crossidKind(IDType type)
 {
-  sllist *idList = NULL;
-  for (int i = 0; i < count; i++) {
-    const gaiastar* star = &stars[i];
-    long gaiaID = star->source_id;
-         
-    FILE* gaiaFile = fopen("/home/jkim/work/Gaia2Mass/IDgaiaSort","rb");
-    if (gaiaFile==NULL)
-      printf("ERROR: file could not open");
-    long other = recurseNewID(0,450646602,gaiaID,gaiaFile,GAIA,outID);
-
-    slappend(&idList,&other,sizeof(long));
-    
-    }
-  return idList;
+  return type == TMASS ? CROSSID_TMASS : type == HAT ? CROSSID_HAT : CROSSID_GAIA;
+}
 
+long* starListToIDs(const gaiastar stars[], IDType outID, int count)
+{
+  long *gaiaIDs = malloc((count > 0 ? count : 1)*sizeof(long));
+  if (gaiaIDs == NULL)
+    err_ret_failure("cannot allocate memory for %d IDs", count);
+  for (int i = 0; i < count; i++)
+    gaiaIDs[i] = stars[i].source_id;
+
+  long *otherIDs = crossid_fromgaia(gaiaIDs, count, crossidKind(outID));
+  free(gaiaIDs);
+  return otherIDs;
 }
 
-// should work on all id types, including a gaia, in which it just returns otherIDt
-char* toGaiaID(const char* otherID, IDType inID, char* buffer)
+long toGaiaID(long otherID, IDType inID)
 {
   if (inID==GAIA)
-    return (char*)otherID;
-  FILE *sortedFile;
-  if (inID==TMASS)
-    sortedFile = fopen("/home/jkim/work/Gaia2Mass/IDtmassSort","rb");
-  else
-    sortedFile = fopen("/home/jkim/work/Gaia2Mass/IDhatSort","rb");
-  if(sortedFile==NULL)
-    printf("ERROR: could not open file");
-  long other = strtol(otherID,NULL,10);
-  long gaiaID = recurseNewID(0,450646602,other,sortedFile,inID,GAIA);
-  fclose(sortedFile);
-  sprintf(buffer,"%ld",gaiaID);
-  return buffer;
+    return otherID;
+  return crossid_togaia(otherID, crossidKind(inID));
 }
 
+// numeric ID index, mapped on the first lookup and kept for the rest of the run. Without it the
+// IDSTSort files written by gaia2idsort are searched
+static idindex numericIndex;
+static int numericState = 0;  // 0: not tried yet, 1: mapped, -1: not available
+
+// an id of a batch lookup: its place in the input list and its index record
 typedef struct
 {
-  long gaia;
-  long tmass;
-  long hat;
-}IDFull;
+	long order;
+	IDElement rec;
+} idrequest;
 
-// uses a binary search algorithm to find an ID within one of the sorted files
-long recurseNewID(long start, long end, long ID, FILE *idFile, IDType intype, IDType outtype)
+local int requestcmp_id(const void *a, const void *b)
 {
+	long id1 = ((const idrequest*)a)->rec.sourceID;
+	long id2 = ((const idrequest*)b)->rec.sourceID;
+	return (id1 > id2) - (id1 < id2);
+}
 
-  while(start <= end)
-    {
-      long mid = (end-start)/2+start;
-        
-      long fileID;
-      if (intype==GAIA)
-        {
-	  fseek(idFile,mid*sizeof(IDFull),SEEK_SET);
-        }
-      else if(intype==TMASS)
-        {
-	  fseek(idFile,mid*sizeof(IDFull)+sizeof(long),SEEK_SET);
-        }
-      else//HAT
-        {
-	  fseek(idFile,mid*sizeof(IDFull)+2*sizeof(long),SEEK_SET);
-        }
-      fread(&fileID,sizeof(long),1,idFile);
+// zone files in order and the stars of a zone by their position in the file
+local int requestcmp_zone(const void *a, const void *b)
+{
+	const IDElement *r1 = &((const idrequest*)a)->rec;
+	const IDElement *r2 = &((const idrequest*)b)->rec;
+	if (r1->zone != r2->zone)
+		return r1->zone < r2->zone ? -1 : 1;
+	return (r1->position > r2->position) - (r1->position < r2->position);
+}
 
-      long compare = ID-fileID;
+local IDElement findID(long gaiaID);
 
-      if (compare < 0)
-        {
-	  end = mid-1;
-        }
-      else if(compare > 0)
-        {
-	  start = mid+1;
-        }
-      else
-        {
-
-	  if (outtype==GAIA)
-            {
-	      fseek(idFile,mid*sizeof(IDFull),SEEK_SET);
-            }
-	  else if(outtype==TMASS)
-            {
-	      fseek(idFile,mid*sizeof(IDFull)+sizeof(long),SEEK_SET);
-            }
-	  else//HAT
-            {
-	      fseek(idFile,mid*sizeof(IDFull)+2*sizeof(long),SEEK_SET);
-            }
-
-	  long targetID;
-	  fread(&targetID,sizeof(long),1,idFile);
-
-	  return targetID;
-        }
-    }
+static idlookup lookupMode = IDLOOKUP_INDEX;
 
-    return 0;
-    
+void gaia2ret_setidlookup(idlookup lookup)
+{
+	lookupMode = lookup;
 }
 
-
-
-// get list of stars from a list of Gaia IDs
-int starsfromID(sllist* longIDs, const double *epoch,gaiastar* stars)
+// reads the stars of the sorted requests from the zone files without an index: each star is searched for
+// within GAIA2_HEALPIX_RADIUS of the center of the HEALPix pixel in its source_id. Neighbouring ids are in
+// neighbouring pixels, so the zone file that is open is usually the right one for the next id
+local void healpixRead(const idrequest requests[], long count, gaiastar* stars)
 {
-  int i = 0;
-	for (const sllist* it = longIDs; it != NULL; it = it->next)
+	zonefile zf;
+	int zone = 0;
+	for (long i = 0; i < count; i++)
 	{
-		char *ptr;
-		long id = strtol(it->data, &ptr, 10);
-		gaiastar nextStar = getStarfromID(id, epoch);
-		stars[i]=nextStar;
-		i++;
+		long id = requests[i].rec.sourceID;
+		double ra, dec;
+		gaia2_healpixpos(id, &ra, &dec);
+		double ra_min, ra_max, dec_min, dec_max;
+		searchBounds(ra, dec, GAIA2_HEALPIX_RADIUS, NULL, &ra_min, &ra_max, &dec_min, &dec_max);
+
+		bool found = false;
+		for (int z = zone_fromdec(dec_min); z <= zone_fromdec(dec_max) && !found; z++)
+		{
+			if (z != zone)
+			{
+				if (zone != 0)
+					zone_close(&zf);
+				zone = z;
+				if (!zone_open(&zf, zone))
+				{
+					printf("ERROR: cannot read zone file %d", zone);
+					exit(EXIT_FAILURE);
+				}
+			}
+
+			long minIndex[2], maxIndex[2];
+			int numRanges = zone_raranges(&zf, ra_min, ra_max, minIndex, maxIndex);
+			for (int r = 0; r < numRanges && !found; r++)
+				for (long k = minIndex[r]; k <= maxIndex[r] && k < zf.numStars; k++)
+				{
+					if (zone_long(&zf, GAIA_SOURCE_ID, k) == id)
+					{
+						gaiastar *star = &stars[requests[i].order];
+						zone_getpos(&zf, k, star);
+						zone_getrest(&zf, k, star);
+						found = true;
+						break;
+					}
+				}
+		}
+		if (!found)
+		{
+			printf("ERROR: Gaia ID Query does not exist");
+			exit(EXIT_FAILURE);
+		}
 	}
-	return 0;
-
+	if (zone != 0)
+		zone_close(&zf);
 }
 
-// get one star from one id
-gaiastar getStarfromID(long gaiaID, const double *epoch)
+// get list of stars from a list of Gaia IDs
+// The ids are sorted and looked up in one pass over the ID index, then the stars are read zone by zone
+// in file order, each zone file is opened once. The stars are returned in the order of the list.
+// With IDLOOKUP_HEALPIX the sorted ids are searched for in the zone files directly
+int starsfromID(const long gaiaIDs[], long count, const double *epoch,gaiastar* stars)
 {
-	char stringID[20];
-	sprintf(stringID,"%ld",gaiaID);
-
-    // based on the first char of the gaiaID, look in the appropriate id file
-	char *fileName;
-	int numStars;
-	if (stringID[0]=='1')
-	{
-		fileName = "/home/jkim/work/Gaia2Bin/IDSTSort/id1";
-		numStars = 116724371;
-	}
-	else if (stringID[0]=='2')
-	{
-		fileName = "/home/jkim/work/Gaia2Bin/IDSTSort/id2";
-		numStars = 163285128;
-	}
-	else if (stringID[0]=='3')
+	if (count == 0)
+		return 0;
+
+	idrequest *requests = malloc(count*sizeof(idrequest));
+	if (requests == NULL)
+		err_ret_failure("cannot allocate memory for %ld IDs", count);
+	long i = 0;
+	for (i = 0; i < count; i++)
 	{
-		fileName = "/home/jkim/work/Gaia2Bin/IDSTSort/id3";
-		numStars = 87098579;
+		requests[i].order = i;
+		requests[i].rec.sourceID = gaiaIDs[i];
 	}
-	else if (stringID[0]=='4')
+	qsort(requests, count, sizeof(idrequest), requestcmp_id);
+
+	if (lookupMode == IDLOOKUP_HEALPIX)
 	{
-		fileName = "/home/jkim/work/Gaia2Bin/IDSTSort/id4";
-		numStars = 585793870;
+		healpixRead(requests, count, stars);
+		free(requests);
+		gaia2_propagatelist(stars, count, epoch, NULL);
+		return 0;
 	}
-	else if (stringID[0]=='5')
+
+	// look up the sorted ids
+	if (numericState == 0)
+		numericState = idindex_open(&numericIndex) ? 1 : -1;
+	if (numericState > 0)
 	{
-		fileName = "/home/jkim/work/Gaia2Bin/IDSTSort/id5";
-		numStars = 531853513;
+		long *ids = malloc(count*sizeof(long));
+		const IDElement **found = malloc(count*sizeof(IDElement*));
+		if (ids == NULL || found == NULL)
+			err_ret_failure("cannot allocate memory for %ld IDs", count);
+		for (i = 0; i < count; i++)
+			ids[i] = requests[i].rec.sourceID;
+		idindex_findsorted(&numericIndex, ids, count, found);
+		for (i = 0; i < count; i++)
+		{
+			if (found[i] != NULL)
+				requests[i].rec = *found[i];
+			else
+				requests[i].rec.sourceID = 0;
+		}
+		free(ids);
+		free(found);
 	}
-	else if (stringID[0]=='6')
+	else
 	{
-		fileName = "/home/jkim/work/Gaia2Bin/IDSTSort/id6";
-		numStars = 203648450;
+		for (i = 0; i < count; i++)
+			requests[i].rec = findID(requests[i].rec.sourceID);
 	}
-	else if (stringID[0]=='7')
+
+	for (i = 0; i < count; i++)
 	{
-		fileName = "/home/jkim/work/Gaia2Bin/IDSTSort/id7";
-		numStars = 1990817;
+		if (requests[i].rec.sourceID == 0)
+		{
+			printf("ERROR: Gaia ID Query does not exist");
+			exit(EXIT_FAILURE);
+		}
 	}
-	else if (stringID[0]=='8')
+
+	// read the stars zone by zone
+	qsort(requests, count, sizeof(idrequest), requestcmp_zone);
+	zonefile zf;
+	int zone = 0;
+	for (i = 0; i < count; i++)
 	{
-		fileName = "/home/jkim/work/Gaia2Bin/IDSTSort/id8";
-		numStars = 3698075;
+		const IDElement *rec = &requests[i].rec;
+		if (rec->zone != zone)
+		{
+			if (zone != 0)
+				zone_close(&zf);
+			zone = rec->zone;
+			if (!zone_open(&zf, zone))
+			{
+				printf("ERROR: cannot read zone file %d", zone);
+				exit(EXIT_FAILURE);
+			}
+		}
+		long index = zone_binindex(rec->position);
+		if (index < 0 || index >= zf.numStars)
+		{
+			printf("ERROR: cannot read star %ld from zone file %d", rec->sourceID, zone);
+			exit(EXIT_FAILURE);
+		}
+		gaiastar *star = &stars[requests[i].order];
+		zone_getpos(&zf, index, star);
+		zone_getrest(&zf, index, star);
 	}
-	else
+	if (zone != 0)
+		zone_close(&zf);
+	free(requests);
+
+	// proper motion for the whole list at once
+	gaia2_propagatelist(stars, count, epoch, NULL);
+	return 0;
+
+}
+
+// finds the index record of a source id in the numeric index or else in the IDSTSort files. The
+// record has a zero sourceID if the id is not in the catalog
+local IDElement findID(long gaiaID)
+{
+	if (numericState == 0)
+		numericState = idindex_open(&numericIndex) ? 1 : -1;
+	if (numericState > 0)
 	{
-		fileName = "/home/jkim/work/Gaia2Bin/IDSTSort/id9";
-		numStars = 6507262;
+		const IDElement *found = idindex_find(&numericIndex, gaiaID);
+		if (found != NULL)
+			return *found;
+		IDElement null = {0, 0, 0};
+		return null;
 	}
 
+	char stringID[20];
+	sprintf(stringID,"%ld",gaiaID);
+
+    // based on the first char of the gaiaID, look in the appropriate id file
+	char digit[2] = { stringID[0] >= '1' && stringID[0] <= '8' ? stringID[0] : '9', '\0' };
+	char *fileName = concat(catalog_get()->idSort, digit);
+
 	FILE *idFile = fopen(fileName,"rb");
-    // use binary search to find the id within the file
-	IDElement targetID = recurseID(0, numStars, gaiaID, idFile);
-	fclose(idFile);
-	if (targetID.sourceID==0)
+	free(fileName);
+	if (idFile == NULL)
 	{
-		printf("ERROR: Gaia ID Query does not exist");
+		printf("ERROR: no ID index found");
 		exit(EXIT_FAILURE);
 	}
-	char zone[4];
-	sprintf(zone,"%d",targetID.zone);
-	char * catpath = "/home/jkim/work/Gaia2Bin/sortedBin/z";
-	char *zoneFileName = concat(catpath,zone);
-
-	FILE *zoneFile = fopen(zoneFileName,"rb");
-	fseek(zoneFile,targetID.position,SEEK_SET);
-	gaiastar targetStar;
-	fread((void*)&targetStar,sizeof(gaiastar),1,zoneFile);
-	fclose(zoneFile);
-
-    // apply proper motion if necessary
-    if ( epoch ) {
-        const double tdiff = ( *epoch - 2015.5 );
-        pmotion_apply( &targetStar.ra, &targetStar.dec,targetStar.pmra, targetStar.pmdec, tdiff );
-    }
-	return targetStar;
+	fseek(idFile,0,SEEK_END);
+	long numStars = ftell(idFile)/sizeof(IDElement);
+
+    // use binary search to find the id within the file
+	IDElement targetID = recurseID(0, numStars-1, gaiaID, idFile);
+	fclose(idFile);
+	return targetID;
 }
 
 // uses a binary search algorithm to find the id within a file. If not found, it returns NULL
@@ -450,64 +417,16 @@ IDElement recurseID(long start, long end, long gaiaID, FILE *idFile)
 	
 }
 
-// checks to make sure star is within box and applies proper motion
-bool test_star(gaiastar* star, double centRA, double centDec, double half_size, const double *epoch)
+// box test of a block of stars, proper motion already applied
+void test_starblock(const double ra[], const double dec[], int n, double centRA, double centDec, double half_size, bool pass[])
 {
-  // apply pm                                                                                                                                                                                                                                                                 
-  if ( epoch ) {
-    const double tdiff = ( *epoch - 2015.5 );
-      pmotion_apply( &star->ra, &star->dec,star->pmra, star->pmdec, tdiff );
-  }
-   
-    if ( half_size > 0 ) {
-        real xi, eta;
-        astr_rgnomonic(
-            star->ra, star->dec,
-            centRA, centDec,
-            &xi, &eta
-        );
-
-        if (    xi > half_size
-            ||  xi < -half_size
-            ||  eta > half_size
-            ||  eta < -half_size
-        ) {
-            return false;
-        }
-    }
-   
-    return true;
+    kern_box( ra, dec, n, centRA, centDec, half_size, pass );
 }
 
-// tests star to make sure it is within the circle and then applies proper motion
-bool test_starcirc(gaiastar* star,double centRA,double centDec,double radius, const double *epoch)
+// circle test of a block of stars, proper motion already applied
+void test_starcircblock(const double ra[], const double dec[], int n, double centRA, double centDec, double radius, bool pass[])
 {
-  // apply pm                                                                                                                                                                                                                                                                 
-  if ( epoch ) {
-    const double tdiff = ( *epoch - 2015.5 );
-      pmotion_apply( &star->ra, &star->dec,star->pmra, star->pmdec, tdiff );
-  }
-
-    real xi, eta;
-    astr_rgnomonic(
-        star->ra, star->dec,
-        centRA, centDec,
-        &xi, &eta
-    );
-
-    if (    xi > radius
-        ||  xi < -radius
-        ||  eta > radius
-        ||  eta < -radius
-    ) {
-        return false;
-    }
-
-    if ( mdist2( xi, eta ) > radius * radius ) {
-        return false;
-    }
-  
-    return true;
+    kern_cone( ra, dec, n, centRA, centDec, radius, pass );
 }
 
 
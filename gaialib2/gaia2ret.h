@@ -2,33 +2,39 @@
 #define GAIA2_RET_H__
 
 #include "gaiastar.h"
-#include "sllist.h"
 
 typedef enum
 {
 	GAIA,HAT,TMASS
 } IDType;
 
-// returns count of stars in for the size of an array
-int starPosCount(double ra, double dec, bool circle, double frame_size,const double *epoch);
+// hands the stars found to the visitor as they are read, without storing them, precessed to equinox [years] if it is not NULL.
+// Returns the number of stars visited
+int starPosWalk(double ra, double dec, bool circle, double frame_size, const double *epoch, const double *equinox, starvisitor visit, void *args);
 
-// returns list of stars given size, circle or rectangular, and center ra and dec
-int starPosSearch(double ra, double dec, bool circle, double frame_size, const double *epoch,gaiastar* stars);
+// how starsfromID finds the stars of the ids
+typedef enum
+{
+	IDLOOKUP_INDEX,    // through the ID index (IDIndex/ids, or IDSTSort without it)
+	IDLOOKUP_HEALPIX   // near the HEALPix pixel encoded in the source_id, without any index
+} idlookup;
 
-// get list of stars from a list of Gaia IDs
-int starsfromID(sllist* longIDs, const double *epoch,gaiastar* stars);
+// selects how starsfromID finds the stars (IDLOOKUP_INDEX by default)
+void gaia2ret_setidlookup(idlookup lookup);
 
-//from starlist to either an array of hat or 2mass ids
-sllist* starListToIDs(gaiastar* stars, IDType outID,int count);
+// get the stars of count Gaia IDs, in the same order
+int starsfromID(const long gaiaIDs[], long count, const double *epoch,gaiastar* stars);
 
-// should work on all id types, including a gaia, in which it just returns otherIDt
-char* toGaiaID(const char* otherID, IDType inID, char* buffer);
+// the hat or 2mass ids of the stars, in the same order and 0 for the stars without one. The stars are joined
+// with the cross-ID file in one batch (see gaia2crossid.h), the array must be freed by the caller
+long* starListToIDs(const gaiastar stars[], IDType outID, int count);
 
-// checks to make sure star is within box and applies proper motion
-bool test_star(gaiastar* star, double centRA, double centDec, double half_size, const double *epoch);
+// the Gaia source id of an ID of any type (a Gaia id is returned as it is), 0 if it is not known
+long toGaiaID(long otherID, IDType inID);
 
-// tests star to make sure it is within the circle and then applies proper motion
-bool test_starcirc(gaiastar* star,double centRA,double centDec,double radius, const double *epoch);
+// the box and circle tests on a block of n stars already moved to the epoch of the query (see testfunc in gaia2cat.h)
+void test_starblock(const double ra[], const double dec[], int n, double centRA, double centDec, double half_size, bool pass[]);
+void test_starcircblock(const double ra[], const double dec[], int n, double centRA, double centDec, double radius, bool pass[]);
 
 #endif
 
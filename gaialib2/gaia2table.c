@@ -0,0 +1,401 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "gaia2table.h"
+#include "utils.h"
+
+// BINARY OUTPUT:
+// The rows are packed column by column into the buffer of the starprinter (gaiaPrint.c), which is written with
+// one fwrite for each megabyte. The values keep their type of the gaiastar, so there is no decimal conversion on the way out and the
+// records can be mapped as they are by the reader.
+
+#define FITS_BLOCK 2880
+#define FITS_CARD 80
+#define RAW_ALIGN 64
+
+const gaiacolumn gaia2columns[GAIA2_NCOLUMNS] =
+{
+  { "ID",                           NULL,       COLUMN_ID,     offsetof(gaiastar, source_id) },
+  { "RA",                           "deg",      COLUMN_DOUBLE, offsetof(gaiastar, ra) },
+  { "Dec",                          "deg",      COLUMN_DOUBLE, offsetof(gaiastar, dec) },
+  { "RAError",                      "mas",      COLUMN_DOUBLE, offsetof(gaiastar, ra_error) },
+  { "DecError",                     "mas",      COLUMN_DOUBLE, offsetof(gaiastar, dec_error) },
+  { "Parallax",                     "mas",      COLUMN_DOUBLE, offsetof(gaiastar, parallax) },
+  { "Parallax_error",               "mas",      COLUMN_DOUBLE, offsetof(gaiastar, parallax_error) },
+  { "PM_RA",                        "mas/yr",   COLUMN_DOUBLE, offsetof(gaiastar, pmra) },
+  { "PM_Dec",                       "mas/year", COLUMN_DOUBLE, offsetof(gaiastar, pmdec) },
+  { "PMRA_error",                   "mas/yr",   COLUMN_DOUBLE, offsetof(gaiastar, pmra_error) },
+  { "PMDec_error",                  "mas/yr",   COLUMN_DOUBLE, offsetof(gaiastar, pmdec_error) },
+  { "Ref_Epoch",                    "yr",       COLUMN_DOUBLE, offsetof(gaiastar, ref_epoch) },
+  { "AstExcNoise",                  "mas",      COLUMN_DOUBLE, offsetof(gaiastar, astrometric_excess_noise) },
+  { "AstExcNoiseSig",               NULL,       COLUMN_DOUBLE, offsetof(gaiastar, astrometric_excess_noise_sig) },
+  { "AstPriFlag",                   NULL,       COLUMN_BOOL,   offsetof(gaiastar, astrometric_primary_flag) },
+  { "phot_g_n_obs",                 NULL,       COLUMN_INT,    offsetof(gaiastar, phot_g_n_obs) },
+  { "phot_g_mean_flux",             NULL,       COLUMN_DOUBLE, offsetof(gaiastar, phot_g_mean_flux) },
+  { "phot_g_mean_flux_error",       NULL,       COLUMN_DOUBLE, offsetof(gaiastar, phot_g_mean_flux_error) },
+  { "phot_g_mean_flux_over_error",  NULL,       COLUMN_FLOAT,  offsetof(gaiastar, phot_g_mean_flux_over_error) },
+  { "phot_g_mean_mag",              NULL,       COLUMN_FLOAT,  offsetof(gaiastar, phot_g_mean_mag) },
+  { "phot_bp_n_obs",                NULL,       COLUMN_INT,    offsetof(gaiastar, phot_bp_n_obs) },
+  { "phot_bp_mean_flux",            NULL,       COLUMN_DOUBLE, offsetof(gaiastar, phot_bp_mean_flux) },
+  { "phot_bp_mean_flux_error",      NULL,       COLUMN_DOUBLE, offsetof(gaiastar, phot_bp_mean_flux_error) },
+  { "phot_bp_mean_flux_over_error", NULL,       COLUMN_FLOAT,  offsetof(gaiastar, phot_bp_mean_flux_over_error) },
+  { "phot_bp_mean_mag",             NULL,       COLUMN_FLOAT,  offsetof(gaiastar, phot_bp_mean_mag) },
+  { "phot_rp_n_obs",                NULL,       COLUMN_INT,    offsetof(gaiastar, phot_rp_n_obs) },
+  { "phot_rp_mean_flux",            NULL,       COLUMN_DOUBLE, offsetof(gaiastar, phot_rp_mean_flux) },
+  { "phot_rp_mean_flux_error",      NULL,       COLUMN_DOUBLE, offsetof(gaiastar, phot_rp_mean_flux_error) },
+  { "phot_rp_mean_flux_over_error", NULL,       COLUMN_FLOAT,  offsetof(gaiastar, phot_rp_mean_flux_over_error) },
+  { "phot_rp_mean_mag",             NULL,       COLUMN_FLOAT,  offsetof(gaiastar, phot_rp_mean_mag) },
+  { "phot_bp_rp_excess_factor",     NULL,       COLUMN_FLOAT,  offsetof(gaiastar, phot_bp_rp_excess_factor) },
+  { "radial_velocity",              NULL,       COLUMN_DOUBLE, offsetof(gaiastar, radial_velocity) },
+  { "radial_velocity_error",        NULL,       COLUMN_DOUBLE, offsetof(gaiastar, radial_velocity_error) },
+  { "phot_variable_flag",           NULL,       COLUMN_BOOL,   offsetof(gaiastar, phot_variable_flag) },
+  { "teff_val",                     NULL,       COLUMN_FLOAT,  offsetof(gaiastar, teff_val) },
+  { "teff_percentile_lower",        NULL,       COLUMN_FLOAT,  offsetof(gaiastar, teff_percentile_lower) },
+  { "teff_percentile_upper",        NULL,       COLUMN_FLOAT,  offsetof(gaiastar, teff_percentile_upper) },
+  { "a_g_val",                      NULL,       COLUMN_FLOAT,  offsetof(gaiastar, a_g_val) },
+  { "a_g_percentile_lower",         NULL,       COLUMN_FLOAT,  offsetof(gaiastar, a_g_percentile_lower) },
+  { "a_g_percentile_upper",         NULL,       COLUMN_FLOAT,  offsetof(gaiastar, a_g_percentile_upper) },
+  { "e_bp_min_rp_val",              NULL,       COLUMN_FLOAT,  offsetof(gaiastar, e_bp_min_rp_val) },
+  { "e_bp_min_rp_percentile_lower", NULL,       COLUMN_FLOAT,  offsetof(gaiastar, e_bp_min_rp_percentile_lower) },
+  { "e_bp_min_rp_percentile_upper", NULL,       COLUMN_FLOAT,  offsetof(gaiastar, e_bp_min_rp_percentile_upper) },
+  { "radius_val",                   NULL,       COLUMN_FLOAT,  offsetof(gaiastar, radius_val) },
+  { "radius_percentile_lower",      NULL,       COLUMN_FLOAT,  offsetof(gaiastar, radius_percentile_lower) },
+  { "radius_percentile_upper",      NULL,       COLUMN_FLOAT,  offsetof(gaiastar, radius_percentile_upper) },
+  { "lum_val",                      NULL,       COLUMN_FLOAT,  offsetof(gaiastar, lum_val) },
+  { "lum_percentile_lower",         NULL,       COLUMN_FLOAT,  offsetof(gaiastar, lum_percentile_lower) },
+  { "lum_percentile_upper",         NULL,       COLUMN_FLOAT,  offsetof(gaiastar, lum_percentile_upper) }
+};
+
+// bytes of a value of the column
+local int columnSize(columntype type)
+{
+  switch (type)
+    {
+    case COLUMN_ID:
+    case COLUMN_DOUBLE:
+      return 8;
+    case COLUMN_FLOAT:
+    case COLUMN_INT:
+      return 4;
+    default:
+      return 1;
+    }
+}
+
+local int numColumns(bool extra)
+{
+  return extra ? GAIA2_NCOLUMNS : GAIA2_NDEFAULTCOLUMNS;
+}
+
+// bytes of a row, with the alternate ID column
+local int rowSize(bool extra, IDType type)
+{
+  int size = type == GAIA ? 0 : 8;
+  for (int c = 0; c < numColumns(extra); c++)
+    size += columnSize(gaia2columns[c].type);
+  return size;
+}
+
+local const char* altIDName(IDType type)
+{
+  return type == TMASS ? "2MASS ID" : "HAT ID";
+}
+
+// writes the size low bytes of value, most significant first for FITS
+local inline unsigned char* putBytes(unsigned char* p, unsigned long value, int size, bool bigEndian)
+{
+  for (int i = 0; i < size; i++)
+    p[bigEndian ? size - 1 - i : i] = (unsigned char)(value >> (8*i));
+  return p + size;
+}
+
+// one value of a column, NaN for the missing ones. FITS is big-endian and has the logicals T and F
+local unsigned char* putValue(unsigned char* p, const gaiastar* star, const gaiacolumn* col, bool fits)
+{
+  const char* field = (const char*)star + col->offset;
+  switch (col->type)
+    {
+    case COLUMN_ID:
+      {
+        long id;
+        memcpy(&id, field, sizeof(long));
+        return putBytes(p, (unsigned long)id, 8, fits);
+      }
+    case COLUMN_DOUBLE:
+      {
+        double val;
+        unsigned long bits;
+        memcpy(&val, field, sizeof(double));
+        if (fabs(3.55-val)<1e-7)
+          val = NAN;
+        memcpy(&bits, &val, sizeof(double));
+        return putBytes(p, bits, 8, fits);
+      }
+    case COLUMN_FLOAT:
+      {
+        float val;
+        unsigned int bits;
+        memcpy(&val, field, sizeof(float));
+        if (fabs(3.55-val)<1e-7)
+          val = NAN;
+        memcpy(&bits, &val, sizeof(float));
+        return putBytes(p, bits, 4, fits);
+      }
+    case COLUMN_INT:
+      {
+        int val;
+        memcpy(&val, field, sizeof(int));
+        return putBytes(p, (unsigned int)val, 4, fits);
+      }
+    default:
+      {
+        bool val;
+        memcpy(&val, field, sizeof(bool));
+        *p++ = fits ? (val ? 'T' : 'F') : val;
+        return p;
+      }
+    }
+}
+
+unsigned char* table_putrow(unsigned char* p, outformat format, const gaiastar* star, bool extra, long alternateID, IDType type)
+{
+  bool fits = format == FORMAT_FITS;
+  p = putValue(p, star, &gaia2columns[0], fits);
+  if (type != GAIA)
+    p = putBytes(p, (unsigned long)alternateID, 8, fits);
+  for (int c = 1; c < numColumns(extra); c++)
+    p = putValue(p, star, &gaia2columns[c], fits);
+  return p;
+}
+
+// -------------------------------------------------------------------------- +
+// FITS headers
+
+// appends a card: the keyword and the value text from column 11, only the keyword without a value
+local char* putCard(char* p, const char* key, const char* text)
+{
+  char card[FITS_CARD + 1];
+  int n = text == NULL ? snprintf(card, sizeof(card), "%-8.8s", key)
+                       : snprintf(card, sizeof(card), "%-8.8s= %s", key, text);
+  if (n > FITS_CARD)
+    n = FITS_CARD;
+  memset(card + n, ' ', FITS_CARD - n);
+  memcpy(p, card, FITS_CARD);
+  return p + FITS_CARD;
+}
+
+// numbers and logicals end in column 30
+local char* putIntCard(char* p, const char* key, long value)
+{
+  char text[24];
+  sprintf(text, "%20ld", value);
+  return putCard(p, key, text);
+}
+
+local char* putLogicalCard(char* p, const char* key, bool value)
+{
+  return putCard(p, key, value ? "                   T" : "                   F");
+}
+
+// strings are quoted and at least 8 characters long
+local char* putStringCard(char* p, const char* key, const char* value)
+{
+  char text[FITS_CARD];
+  snprintf(text, sizeof(text), "'%-8s'", value);
+  return putCard(p, key, text);
+}
+
+// a keyword of a column: TTYPEn, TFORMn, ...
+local char* putColumnCard(char* p, const char* key, int index, const char* value)
+{
+  char name[24];
+  sprintf(name, "%s%d", key, index);
+  return putStringCard(p, name, value);
+}
+
+// pads a header to a whole block with blanks
+local char* padBlock(char* start, char* p)
+{
+  while ((p - start) % FITS_BLOCK != 0)
+    *p++ = ' ';
+  return p;
+}
+
+local const char* fitsForm(columntype type)
+{
+  switch (type)
+    {
+    case COLUMN_ID:
+      return "K";
+    case COLUMN_DOUBLE:
+      return "D";
+    case COLUMN_FLOAT:
+      return "E";
+    case COLUMN_INT:
+      return "J";
+    default:
+      return "L";
+    }
+}
+
+// the NAXIS2 card, the fifth of the extension header
+local char* putRowsCard(char* p, long numRows)
+{
+  return putIntCard(p, "NAXIS2", numRows);
+}
+
+local long fitsBegin(FILE* out, bool extra, IDType type)
+{
+  long start = ftell(out);
+  if (start < 0 || fseek(out, start, SEEK_SET) != 0)
+    return -1;
+
+  int ncols = numColumns(extra) + (type != GAIA);
+  // 4 cards for each column at most, 12 others
+  size_t size = ((size_t)(4*ncols + 12)*FITS_CARD/FITS_BLOCK + 2)*FITS_BLOCK;
+  char* header = malloc(size);
+  if (header == NULL)
+    err_ret_failure("cannot allocate memory for the FITS header");
+
+  // primary HDU without data
+  char* p = header;
+  p = putLogicalCard(p, "SIMPLE", true);
+  p = putIntCard(p, "BITPIX", 8);
+  p = putIntCard(p, "NAXIS", 0);
+  p = putLogicalCard(p, "EXTEND", true);
+  p = putCard(p, "END", NULL);
+  p = padBlock(header, p);
+
+  p = putStringCard(p, "XTENSION", "BINTABLE");
+  p = putIntCard(p, "BITPIX", 8);
+  p = putIntCard(p, "NAXIS", 2);
+  p = putIntCard(p, "NAXIS1", rowSize(extra, type));
+  p = putRowsCard(p, 0);
+  p = putIntCard(p, "PCOUNT", 0);
+  p = putIntCard(p, "GCOUNT", 1);
+  p = putIntCard(p, "TFIELDS", ncols);
+
+  int index = 1;
+  for (int c = 0; c < numColumns(extra); c++)
+    {
+      const gaiacolumn* col = &gaia2columns[c];
+      p = putColumnCard(p, "TTYPE", index, c == 0 ? "Gaia ID" : col->name);
+      p = putColumnCard(p, "TFORM", index, fitsForm(col->type));
+      if (col->unit != NULL)
+        p = putColumnCard(p, "TUNIT", index, col->unit);
+      index++;
+
+      if (c == 0 && type != GAIA)
+        {
+          p = putColumnCard(p, "TTYPE", index, altIDName(type));
+          p = putColumnCard(p, "TFORM", index, "K");
+          char key[24];
+          sprintf(key, "TNULL%d", index);
+          p = putIntCard(p, key, 0);
+          index++;
+        }
+    }
+  p = putCard(p, "END", NULL);
+  p = padBlock(header, p);
+
+  fwrite(header, 1, p - header, out);
+  free(header);
+  return start;
+}
+
+local void fitsEnd(FILE* out, long start, long numRows, bool extra, IDType type)
+{
+  // the data is padded with zeros to a whole block
+  long dataSize = numRows*rowSize(extra, type);
+  long padding = (FITS_BLOCK - dataSize % FITS_BLOCK) % FITS_BLOCK;
+  char zeros[FITS_BLOCK];
+  memset(zeros, 0, sizeof(zeros));
+  fwrite(zeros, 1, padding, out);
+
+  char card[FITS_CARD];
+  putRowsCard(card, numRows);
+  if (fseek(out, start + FITS_BLOCK + 4*FITS_CARD, SEEK_SET) != 0
+      || fwrite(card, 1, FITS_CARD, out) != FITS_CARD
+      || fseek(out, 0, SEEK_END) != 0)
+    err_print_msg("cannot write the number of rows of the FITS table");
+}
+
+// -------------------------------------------------------------------------- +
+// raw schema
+
+local const char* rawType(columntype type)
+{
+  switch (type)
+    {
+    case COLUMN_ID:
+      return "i8";
+    case COLUMN_DOUBLE:
+      return "f8";
+    case COLUMN_FLOAT:
+      return "f4";
+    case COLUMN_INT:
+      return "i4";
+    default:
+      return "b1";
+    }
+}
+
+local long rawBegin(FILE* out, bool extra, IDType type)
+{
+  // the column lines first, the first line gives the length of the whole schema
+  int ncols = numColumns(extra) + (type != GAIA);
+  char* columns = malloc((size_t)ncols*128);
+  if (columns == NULL)
+    err_ret_failure("cannot allocate memory for the raw schema");
+
+  char* p = columns;
+  int offset = 0;
+  for (int c = 0; c < numColumns(extra); c++)
+    {
+      const gaiacolumn* col = &gaia2columns[c];
+      p += sprintf(p, "%d\t%s\t%s\t%s\n", offset, rawType(col->type), c == 0 ? "Gaia ID" : col->name,
+                   col->unit != NULL ? col->unit : "");
+      offset += columnSize(col->type);
+      if (c == 0 && type != GAIA)
+        {
+          p += sprintf(p, "%d\ti8\t%s\t\n", offset, altIDName(type));
+          offset += 8;
+        }
+    }
+
+  // the schema length is counted with a first line as long as the one it gives
+  char first[128];
+  long size = 0, length;
+  do
+    {
+      length = size;
+      int n = sprintf(first, "GAIA2RAW %d %ld %d %d\n", GAIA2_RAWVERSION, length, offset, ncols);
+      size = (n + (p - columns) + RAW_ALIGN - 1)/RAW_ALIGN*RAW_ALIGN;
+    }
+  while (size != length);
+
+  long start = ftell(out);
+  fputs(first, out);
+  fwrite(columns, 1, p - columns, out);
+  for (long n = strlen(first) + (p - columns); n < size; n++)
+    fputc('\n', out);
+  free(columns);
+  return start < 0 ? 0 : start;
+}
+
+long table_begin(FILE* out, outformat format, bool extra, IDType type)
+{
+  if (format == FORMAT_FITS)
+    return fitsBegin(out, extra, type);
+  if (format == FORMAT_RAW)
+    return rawBegin(out, extra, type);
+  return 0;
+}
+
+void table_end(FILE* out, outformat format, long start, long numRows, bool extra, IDType type)
+{
+  if (format == FORMAT_FITS)
+    fitsEnd(out, start, numRows, extra, type);
+}
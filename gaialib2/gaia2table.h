@@ -0,0 +1,65 @@
+#ifndef GAIA2_TABLE_H__
+#define GAIA2_TABLE_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "gaiastar.h"
+#include "gaia2ret.h"
+
+// output formats of gaia2read: the text columns of gaiaPrint.c, a FITS binary table or raw packed records
+typedef enum
+{
+  FORMAT_TEXT,
+  FORMAT_FITS,
+  FORMAT_RAW
+} outformat;
+
+// The columns of the output, in the order of gaiastar_printheader: the first GAIA2_NDEFAULTCOLUMNS are always
+// written, the others with --extra. The binary formats write the Gaia source id in the first column and, with
+// an alternate ID type, the 2MASS or HAT ID after it (0 when the star has none). The missing values (3.55, n/a
+// in the text) are NaN.
+typedef enum
+{
+  COLUMN_ID,       // long
+  COLUMN_DOUBLE,
+  COLUMN_FLOAT,
+  COLUMN_INT,
+  COLUMN_BOOL
+} columntype;
+
+typedef struct
+{
+  const char *name;
+  const char *unit;   // NULL without one
+  columntype type;
+  size_t offset;      // in gaiastar
+} gaiacolumn;
+
+#define GAIA2_NCOLUMNS 49
+#define GAIA2_NDEFAULTCOLUMNS 15
+
+extern const gaiacolumn gaia2columns[GAIA2_NCOLUMNS];
+
+// FITS: an empty primary HDU and a BINTABLE extension, big-endian, padded to 2880 byte blocks. The number of
+// rows is written by table_end, so the output must be a file.
+//
+// RAW: a text schema, then the records packed without padding in the order of the columns, little-endian, until
+// the end of the file. The schema is padded with newlines to a multiple of 64 bytes:
+//   GAIA2RAW <version> <schema bytes> <record bytes> <columns>
+//   one line for each column: <offset in the record>\t<type>\t<name>\t<unit>
+// with the types i8 (long), f8 (double), f4 (float), i4 (int) and b1 (bool, 0 or 1).
+#define GAIA2_RAWVERSION 1
+
+// writes the headers of a binary format. Returns the offset of the output it started at, or -1 if it cannot be
+// written: the FITS table needs an output it can seek
+long table_begin(FILE* out, outformat format, bool extra, IDType type);
+
+// packs the row of a star at p and returns the end of the row, alternateID is the ID of the type (unused for
+// GAIA). A row has at most 8 bytes for each column and the alternate ID
+unsigned char* table_putrow(unsigned char* p, outformat format, const gaiastar* star, bool extra, long alternateID, IDType type);
+
+// completes a table of numRows rows begun at start
+void table_end(FILE* out, outformat format, long start, long numRows, bool extra, IDType type);
+
+#endif
@@ -0,0 +1,379 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "gaia2zone.h"
+#include "gaia2catalog.h"
+#include "utils.h"
+
+// MEMORY-MAPPED ZONE FILES:
+// Every zone file is mapped the first time a query opens it and stays mapped until zone_closeall
+// (see CACHED ZONES). The ra zone header is used in place as an int array and the stars are
+// filtered straight from the mapping, so a scan costs no seeks or reads beyond the page faults
+// of the records that are actually touched.
+//
+// COLUMN LAYOUT:
+// The sortedCol zone files hold the same stars in the same order, but as one array per field.
+// The position tests only need source_id, ra, dec, pmra and pmdec, so a scan reads 40 bytes per
+// candidate instead of the 296 byte record and the rest is gathered for the stars that pass.
+// All layouts are reached through zonecolumn (base and stride), so the scan code is the same.
+//
+// SPLIT LAYOUT:
+// sortedAst holds the astrometric block of the stars (120 bytes) and sortedPhot the photometry block
+// (184 bytes) in the same order. sortedPhot is only mapped when the extra fields are wanted, so the
+// queries without --extra never touch it.
+//
+// CACHED ZONES:
+// The paths of the zone files come from the catalog (gaia2catalog.h). A zone is mapped and its header checked
+// the first time it is opened and the mapping is kept for the rest of the run, so the ID lookups and the
+// queries that come back to a zone do not open, stat and map its file again. zone_close only forgets the
+// caller's copy, zone_closeall unmaps them all.
+
+const char *zone_layoutnames[ZONE_NLAYOUTS] = {"rows", "columns", "split"};
+
+static zonelayout layout = ZONE_ROWS;
+static bool loadextra = true;
+
+static zonefile cache[GAIA2_NZONES+1];
+static pthread_mutex_t cachelock = PTHREAD_MUTEX_INITIALIZER;
+
+// fields read by zone_getpos
+static const int posFields[] = {GAIA_SOURCE_ID, GAIA_RA, GAIA_DEC, GAIA_PMRA, GAIA_PMDEC};
+#define NPOSFIELDS (int)(sizeof(posFields)/sizeof(posFields[0]))
+
+void zone_setlayout(zonelayout l)
+{
+  if (l != layout)
+    zone_closeall();
+  layout = l;
+}
+
+void zone_setextra(bool extra)
+{
+  if (extra != loadextra)
+    zone_closeall();
+  loadextra = extra;
+}
+
+// dec zones go from 1 to 900
+int zone_fromdec(double dec)
+{
+  double dPos = dec + 90.0;
+  if (dPos == 180.0)
+    return GAIA2_NZONES;
+  return (int)(dPos/0.2)+1;
+}
+
+// ra zones go from 0 to 1439
+int zone_fromra(double ra)
+{
+  if (ra == 360.0)
+    return GAIA2_NRAZONES-1;
+  return (int)(ra/0.25);
+}
+
+// sets up the columns of a sortedBin mapping
+local bool rowsInit(zonefile *zf)
+{
+  if (zf->size < GAIA2_NRAZONES*sizeof(int))
+    return false;
+
+  zf->raZones = (const int*)zf->map;
+  zf->stars = (const gaiastar*)((const char*)zf->map + GAIA2_NRAZONES*sizeof(int));
+  zf->numStars = (zf->size - GAIA2_NRAZONES*sizeof(int))/sizeof(gaiastar);
+  for (int f = 0; f < GAIASTAR_NFIELDS; f++)
+    {
+      zf->columns[f].base = (const char*)zf->stars + gaiastar_fields[f].offset;
+      zf->columns[f].stride = sizeof(gaiastar);
+    }
+  return true;
+}
+
+// sets up the columns of a sortedCol mapping, checking the header against this build
+local bool columnsInit(zonefile *zf)
+{
+  if (zf->size < sizeof(zonecolheader))
+    return false;
+
+  const zonecolheader *header = (const zonecolheader*)zf->map;
+  if (memcmp(header->magic, ZONE_COLMAGIC, sizeof(header->magic)) != 0 ||
+      header->version != ZONE_COLVERSION || header->numFields != GAIASTAR_NFIELDS)
+    return false;
+
+  zf->raZones = header->raZones;
+  zf->stars = NULL;
+  zf->numStars = header->numStars;
+  for (int f = 0; f < GAIASTAR_NFIELDS; f++)
+    {
+      size_t length = header->numStars*gaiastar_fields[f].size;
+      if (header->columns[f] < (long)sizeof(zonecolheader) || header->columns[f] + length > zf->size)
+        return false;
+      zf->columns[f].base = f < GAIASTAR_NASTROMETRIC || loadextra ? (const char*)zf->map + header->columns[f] : NULL;
+      zf->columns[f].stride = gaiastar_fields[f].size;
+    }
+  return true;
+}
+
+// sets up the columns of a sortedAst mapping and of the sortedPhot one if it is loaded
+local bool splitInit(zonefile *zf)
+{
+  if (zf->size < GAIA2_NRAZONES*sizeof(int))
+    return false;
+
+  zf->raZones = (const int*)zf->map;
+  zf->stars = NULL;
+  zf->numStars = (zf->size - GAIA2_NRAZONES*sizeof(int))/sizeof(gaiastar_ast);
+  if (zf->photmap != NULL && zf->photsize != zf->numStars*sizeof(gaiastar_phot))
+    return false;
+
+  const char *ast = (const char*)zf->map + GAIA2_NRAZONES*sizeof(int);
+  for (int f = 0; f < GAIASTAR_NFIELDS; f++)
+    {
+      if (f < GAIASTAR_NASTROMETRIC)
+        {
+          zf->columns[f].base = ast + gaiastar_fields[f].splitoffset;
+          zf->columns[f].stride = sizeof(gaiastar_ast);
+        }
+      else
+        {
+          zf->columns[f].base = zf->photmap != NULL ? (const char*)zf->photmap + gaiastar_fields[f].splitoffset : NULL;
+          zf->columns[f].stride = sizeof(gaiastar_phot);
+        }
+    }
+  return true;
+}
+
+// the ra zone header gives the index of the end of each ra zone, which zone_rasearch reads stars at: the ends
+// may not decrease and the last one is the number of stars
+local bool raZonesValid(const zonefile *zf)
+{
+  long end = 0;
+  for (int r = 0; r < GAIA2_NRAZONES; r++)
+    {
+      if (zf->raZones[r] < end)
+        return false;
+      end = zf->raZones[r];
+    }
+  return end == zf->numStars;
+}
+
+// maps a whole file read only, returns NULL if it cannot be opened or is empty
+local void* mapFile(const char *path, int zone, size_t *size)
+{
+  char buffer[12];
+  sprintf(buffer,"%d",zone);
+  char *fileName = concat(path, buffer);
+
+  int fd = open(fileName, O_RDONLY);
+  free(fileName);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+      close(fd);
+      return NULL;
+    }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return NULL;
+
+  *size = st.st_size;
+  return map;
+}
+
+// unmaps a zone file
+local void unmapZone(zonefile *zf)
+{
+  if (zf->map != NULL)
+    munmap(zf->map, zf->size);
+  if (zf->photmap != NULL)
+    munmap(zf->photmap, zf->photsize);
+  zf->map = NULL;
+  zf->size = 0;
+  zf->photmap = NULL;
+  zf->photsize = 0;
+  zf->numStars = 0;
+}
+
+// maps a zone file of the catalog and checks it against its layout and the star count of the manifest
+local bool mapZone(zonefile *zf, int zone, const gaia2catalog *cat)
+{
+  zf->size = 0;
+  zf->photmap = NULL;
+  zf->photsize = 0;
+  zf->numStars = 0;
+  zf->layout = layout;
+
+  const char *path = cat->zonePaths[layout];
+  if (path == NULL)
+    {
+      err_print_msg("the catalog %s does not have the %s layout", cat->path, zone_layoutnames[layout]);
+      return false;
+    }
+  zf->map = mapFile(path, zone, &zf->size);
+  if (zf->map == NULL)
+    return false;
+
+  if (layout == ZONE_SPLIT && loadextra)
+    {
+      zf->photmap = mapFile(cat->photPath, zone, &zf->photsize);
+      if (zf->photmap == NULL)
+        {
+          err_print_msg("cannot open the photometry of zone %d", zone);
+          unmapZone(zf);
+          return false;
+        }
+    }
+
+  bool valid = layout == ZONE_COLUMNS ? columnsInit(zf) : layout == ZONE_SPLIT ? splitInit(zf) : rowsInit(zf);
+  if (!valid)
+    {
+      if (layout != ZONE_ROWS)
+        err_print_msg("zone file %d does not match its layout", zone);
+      unmapZone(zf);
+      return false;
+    }
+  if (cat->zoneStars[zone] >= 0 && zf->numStars != cat->zoneStars[zone])
+    {
+      err_print_msg("zone file %d has %ld stars, the catalog manifest %ld", zone, zf->numStars, cat->zoneStars[zone]);
+      unmapZone(zf);
+      return false;
+    }
+  if (!raZonesValid(zf))
+    {
+      err_print_msg("zone file %d has an invalid ra zone header", zone);
+      unmapZone(zf);
+      return false;
+    }
+  return true;
+}
+
+bool zone_open(zonefile *zf, int zone)
+{
+  if (zone < 1 || zone > GAIA2_NZONES)
+    return false;
+
+  // the catalog is opened first, opening it unmaps the cache
+  const gaia2catalog *cat = catalog_get();
+  pthread_mutex_lock(&cachelock);
+  bool valid = cache[zone].map != NULL || mapZone(&cache[zone], zone, cat);
+  *zf = cache[zone];
+  pthread_mutex_unlock(&cachelock);
+  return valid;
+}
+
+void zone_close(zonefile *zf)
+{
+  // the mapping stays in the cache until zone_closeall
+  zf->map = NULL;
+  zf->size = 0;
+  zf->photmap = NULL;
+  zf->photsize = 0;
+  zf->numStars = 0;
+}
+
+void zone_closeall(void)
+{
+  pthread_mutex_lock(&cachelock);
+  for (int z = 1; z <= GAIA2_NZONES; z++)
+    unmapZone(&cache[z]);
+  pthread_mutex_unlock(&cachelock);
+}
+
+long zone_rasearch(const zonefile *zf, int raZone, double ra, bool minormax)
+{
+  //start is the index of the first star of this zone, end the index of the first star of the next zone
+  long start = raZone == 0 ? 0 : zf->raZones[raZone-1];
+  long end = zf->raZones[raZone];
+
+  for (;;)
+    {
+      long middleStar = start + (end-start)/2;
+      if (middleStar >= end)
+        return end;
+
+      // the search runs on past the last star of the file and stops at the first one
+      double raMiddle = zone_double(zf, GAIA_RA, middleStar);
+      if (raMiddle < ra)
+        {
+          if (middleStar+1 < zf->numStars && zone_double(zf, GAIA_RA, middleStar+1) > ra)
+            return minormax ? middleStar+1 : middleStar;
+          start = middleStar+1;
+        }
+      else if (raMiddle > ra)
+        {
+          if (middleStar == 0 || zone_double(zf, GAIA_RA, middleStar-1) < ra)
+            return minormax ? middleStar : middleStar-1;
+          end = middleStar-1;
+        }
+      else
+        return middleStar;
+    }
+}
+
+int zone_raranges(const zonefile *zf, double raMin, double raMax, long minIndex[2], long maxIndex[2])
+{
+  int rMinZone = zone_fromra(raMin);
+  int rMaxZone = zone_fromra(raMax);
+
+  if(raMax > raMin)
+    {
+      minIndex[0] = zone_rasearch(zf,rMinZone,raMin,true);
+      maxIndex[0] = zone_rasearch(zf,rMaxZone,raMax,false);
+      return 1;
+    }
+
+  //part 1: east
+  minIndex[0] = zone_rasearch(zf,0,0.0,true);
+  maxIndex[0] = zone_rasearch(zf,rMaxZone,raMax,false);
+
+  //part 2: west
+  minIndex[1] = zone_rasearch(zf,rMinZone,raMin,true);
+  maxIndex[1] = zone_rasearch(zf,GAIA2_NRAZONES-1,360.0,false);
+  return 2;
+}
+
+// copies a field of star i into the matching member of star, zero if the field was not loaded
+local inline void getField(const zonefile *zf, int f, long i, gaiastar *star)
+{
+  if (zf->columns[f].base == NULL)
+    memset((char*)star + gaiastar_fields[f].offset, 0, gaiastar_fields[f].size);
+  else
+    memcpy((char*)star + gaiastar_fields[f].offset, zf->columns[f].base + i*zf->columns[f].stride,
+           gaiastar_fields[f].size);
+}
+
+void zone_getpos(const zonefile *zf, long i, gaiastar *star)
+{
+  if (zf->layout == ZONE_ROWS)
+    {
+      *star = zf->stars[i];
+      return;
+    }
+  for (int k = 0; k < NPOSFIELDS; k++)
+    getField(zf, posFields[k], i, star);
+}
+
+void zone_getrest(const zonefile *zf, long i, gaiastar *star)
+{
+  if (zf->layout == ZONE_ROWS)
+    return;
+  for (int f = 0; f < GAIASTAR_NFIELDS; f++)
+    if (f != GAIA_SOURCE_ID && f != GAIA_RA && f != GAIA_DEC && f != GAIA_PMRA && f != GAIA_PMDEC)
+      getField(zf, f, i, star);
+}
+
+long zone_binindex(long position)
+{
+  return (position - (long)(GAIA2_NRAZONES*sizeof(int)))/(long)sizeof(gaiastar);
+}
@@ -0,0 +1,113 @@
+#ifndef GAIA2_ZONE_H__
+#define GAIA2_ZONE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "gaiastar.h"
+
+// number of 0.2 degree dec zone files (z1 ... z900)
+#define GAIA2_NZONES 900
+
+// number of 0.25 degree ra zones in the header of each zone file
+#define GAIA2_NRAZONES 1440
+
+// on-disk layout of the zone files
+typedef enum
+{
+  ZONE_ROWS,      // sortedBin: 1440 ints of cumulative ra zone counts, then the gaiastar records sorted by ra
+  ZONE_COLUMNS,   // sortedCol: a zonecolheader, then one contiguous array per gaiastar field
+  ZONE_SPLIT      // sortedAst: 1440 ints of ra zone counts, then gaiastar_ast records sorted by ra,
+                  // sortedPhot: the gaiastar_phot records in the same order
+} zonelayout;
+
+#define ZONE_NLAYOUTS 3
+
+// names of the layouts in the catalog manifest and for --layout: rows, columns, split
+extern const char *zone_layoutnames[ZONE_NLAYOUTS];
+
+// header of a column layout zone file. The columns follow in the order of gaiastar_fields,
+// each one starts at an 8 byte aligned offset given in columns
+#define ZONE_COLMAGIC "GAIA2COL"
+#define ZONE_COLVERSION 1
+
+typedef struct
+{
+  char magic[8];
+  int version;
+  int numFields;
+  long numStars;
+  int raZones[GAIA2_NRAZONES];
+  long columns[GAIASTAR_NFIELDS];
+} zonecolheader;
+
+// a field of every star in a zone: the value of star i is at base + i*stride
+typedef struct
+{
+  const char *base;
+  size_t stride;
+} zonecolumn;
+
+// a sorted zone file mapped into memory. The fields are reached through columns whatever the layout,
+// stars is only set for the row layout. The columns of fields that were not loaded (see zone_setextra)
+// have a NULL base.
+typedef struct
+{
+  void *map;               // start of the mapping
+  size_t size;             // length of the mapping in bytes
+  void *photmap;           // mapping of the sortedPhot file of the split layout, NULL if not loaded
+  size_t photsize;
+  zonelayout layout;
+  const int *raZones;      // cumulative star counts, GAIA2_NRAZONES entries
+  const gaiastar *stars;   // stars of the zone sorted by ra, NULL for the column layout
+  zonecolumn columns[GAIASTAR_NFIELDS];
+  long numStars;
+} zonefile;
+
+// value of a double or long field of star i
+#define zone_double(zf, field, i) (*(const double*)((zf)->columns[field].base + (i)*(zf)->columns[field].stride))
+#define zone_long(zf, field, i) (*(const long*)((zf)->columns[field].base + (i)*(zf)->columns[field].stride))
+
+// selects the layout of the zone files read by zone_open (ZONE_ROWS by default)
+void zone_setlayout(zonelayout layout);
+
+// whether zone_open loads the photometry and astrophysical parameters (true by default). Without them the
+// split layout only maps sortedAst and zone_getrest leaves these fields at zero. The row layout always has them
+void zone_setextra(bool extra);
+
+// dec zone (1 ... 900) that holds the given declination
+int zone_fromdec(double dec);
+
+// ra zone (0 ... 1439) that holds the given right ascension
+int zone_fromra(double ra);
+
+// maps the sorted zone file of the catalog (see gaia2catalog.h) into memory. The mapping is cached, a zone is
+// only mapped the first time it is opened. Returns false if it cannot be opened or its ra zone header does not
+// match its stars
+bool zone_open(zonefile *zf, int zone);
+
+// releases a zone file opened by zone_open, its mapping stays cached
+void zone_close(zonefile *zf);
+
+// unmaps all the cached zone files, done when the catalog, the layout or the extra fields change
+void zone_closeall(void);
+
+// binary search within an ra zone, returns the index of the first star with ra above
+// the given value (minormax is true) or the last star below it (minormax is false)
+long zone_rasearch(const zonefile *zf, int raZone, double ra, bool minormax);
+
+// finds the index ranges of the stars within the ra range, two of them if the range crosses ra 0 (raMax below
+// raMin). Returns the number of ranges
+int zone_raranges(const zonefile *zf, double raMin, double raMax, long minIndex[2], long maxIndex[2]);
+
+// reads the fields of star i needed by the position tests: source_id, ra, dec, pmra and pmdec
+// (the whole star for the row layout)
+void zone_getpos(const zonefile *zf, long i, gaiastar *star);
+
+// reads the fields of star i that zone_getpos left out
+void zone_getrest(const zonefile *zf, long i, gaiastar *star);
+
+// index of the star at a byte offset of its sortedBin zone file, as stored in the ID files
+long zone_binindex(long position);
+
+#endif
@@ -1,243 +1,404 @@
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include "gaiastar.h"
 #include "gaia2ret.h"
-#include "sllist.h"
+#include "gaiaPrint.h"
+#include "gaia2table.h"
+#include "utils.h"
 
-// format for printing float
-local void printFloat(FILE* out, float val, char* format){//format should have a space in front of it
-  if (fabs(3.55-val)<1e-7)
+// TEXT FORMATTER:
+// A row is formatted into memory field by field and the rows are written with one fwrite for each
+// PRINT_BUFFER bytes. A starprinter keeps its buffer for the whole query, so the stars of a streamed search that
+// arrive one at a time are written in the same large blocks as a list. The fixed point fields are converted from the exact binary value of the double with
+// integer arithmetic, rounding half to even like printf does, so the text is the same as with "%W.Pf". Values
+// that do not fit the integer conversion (2^53 and above, infinities and NaN) still go through sprintf.
+
+// bytes of rows written at once, and the longest row: 49 fields of at most 330 characters (sprintf of a
+// double of 309 digits with 10 decimals) and the ID. The binary rows of gaia2table.c are much shorter
+#define PRINT_BUFFER (1 << 20)
+#define PRINT_MAXROW 20000
+
+static char buffer[PRINT_BUFFER];
+
+static const unsigned long powers10[] = {1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL,
+                                         100000000UL, 1000000000UL, 10000000000UL};
+
+local char* putString(char* p, const char* s)
+{
+  while (*s)
+    *p++ = *s++;
+  return p;
+}
+
+// "%ld"
+local char* putLong(char* p, long val)
+{
+  char digits[24];
+  int n = 0;
+  unsigned long u = val < 0 ? -(unsigned long)val : (unsigned long)val;
+  do
     {
-      char *naFormat;
-      if(strcmp(format," %14.10f")==0)
-	naFormat = " %14s";
-      else
-	naFormat = " %9s";
-      char *na = "n/a";
-      fprintf(out,naFormat,na);
+      digits[n++] = (char)('0' + u % 10);
+      u /= 10;
     }
-  else
-    fprintf(out,format,val);
+  while (u != 0);
+  if (val < 0)
+    *p++ = '-';
+  while (n > 0)
+    *p++ = digits[--n];
+  return p;
 }
 
-// format for printing double
-local void printDouble(FILE* out, double val, char* format){//format should have a space in front of it
-  if (fabs(3.55-val)<1e-7){
-    char *naFormat;
-    if(strcmp(format," %14.10f")==0)
-      naFormat = " %14s";
-    else
-      naFormat = " %9s";
-    char *na = "n/a";
-    fprintf(out,naFormat,na);
-  }
-  else
-    fprintf(out,format,val);
+// "%*s"
+local char* putPadded(char* p, const char* s, int width)
+{
+  for (int n = (int)strlen(s); n < width; n++)
+    *p++ = ' ';
+  return putString(p, s);
 }
 
-// default print options
-local void print_common(FILE* out, const gaiastar* star, long id,IDType type){
-  if(id==0)
-    id = star->source_id;
-  if(type==GAIA)
-    fprintf(out, "%ld",id);
-  else if(type==TMASS)
+// "%*.*f" for precision up to 10
+local char* putFixed(char* p, double val, int width, int precision)
+{
+#if defined(__SIZEOF_INT128__)
+  if (fabs(val) < 9007199254740992.0)
     {
-      char tmassID[16];
-      char str[16];
-      sprintf(str,"%ld",id);
-      if(str[0]=='1')
-	{
-	  tmassID[0]=str[1];
-	  tmassID[1]=str[2];
-	  tmassID[2]=str[3];
-	  tmassID[3]=str[4];
-	  tmassID[4]=str[5];
-	  tmassID[5]=str[6];
-	  tmassID[6]=str[7];
-	  tmassID[7]=str[8];
-	  tmassID[8]='+';
-	  tmassID[9]=str[9];
-	  tmassID[10]=str[10];
-	  tmassID[11]=str[11];
-	  tmassID[12]=str[12];
-	  tmassID[13]=str[13];
-	  tmassID[14]=str[14];
-	  tmassID[15]=str[15];
-	}
+      __extension__ typedef unsigned __int128 uint128;
+
+      // |val| = m*2^-shift exactly, m below 2^53, so m*10^precision fits in 87 bits
+      int e;
+      double f = frexp(fabs(val), &e);
+      unsigned long m = (unsigned long)ldexp(f, 53);
+      int shift = 53 - e;
+      uint128 scaled = (uint128)m * powers10[precision];
+      uint128 n;
+      if (shift <= 0)
+        n = scaled << -shift;
+      else if (shift > 120)
+        n = 0;  // below half a unit of the last digit
       else
-	{
-	  tmassID[0]=str[1];
-          tmassID[1]=str[2];
-          tmassID[2]=str[3];
-          tmassID[3]=str[4];
-          tmassID[4]=str[5];
-          tmassID[5]=str[6];
-          tmassID[6]=str[7];
-          tmassID[7]=str[8];
-          tmassID[8]='-';
-          tmassID[9]=str[9];
-          tmassID[10]=str[10];
-          tmassID[11]=str[11];
-          tmassID[12]=str[12];
-          tmassID[13]=str[13];
-          tmassID[14]=str[14];
-          tmassID[15]=str[15];
-
-	}
-      fprintf(out,"%s",tmassID);
+        {
+          uint128 half = (uint128)1 << (shift - 1);
+          uint128 rest = scaled & ((half << 1) - 1);
+          n = scaled >> shift;
+          if (rest > half || (rest == half && (n & 1)))
+            n++;
+        }
 
+      char digits[48];
+      int numDigits = 0;
+      do
+        {
+          digits[numDigits++] = (char)('0' + (int)(n % 10));
+          n /= 10;
+        }
+      while (n != 0);
+      while (numDigits <= precision)
+        digits[numDigits++] = '0';
+
+      // printf keeps the sign of negative values that round to zero
+      bool negative = signbit(val);
+      for (int len = numDigits + (precision > 0) + negative; len < width; len++)
+        *p++ = ' ';
+      if (negative)
+        *p++ = '-';
+      while (numDigits > precision)
+        *p++ = digits[--numDigits];
+      if (precision > 0)
+        {
+          *p++ = '.';
+          while (numDigits > 0)
+            *p++ = digits[--numDigits];
+        }
+      return p;
     }
-  else if(type==HAT)
+#endif
+  return p + sprintf(p, "%*.*f", width, precision, val);
+}
+
+// a field with a space in front of it, n/a for the missing values: as wide as the field for the 14 character
+// ones, 9 characters for all the others
+local char* putValue(char* p, double val, int width, int precision)
+{
+  *p++ = ' ';
+  if (fabs(3.55-val)<1e-7)
+    return putPadded(p, "n/a", width == 14 ? 14 : 9);
+  return putFixed(p, val, width, precision);
+}
+
+// the floats are printed as the doubles they are promoted to, and compared with 3.55 the same way
+local inline char* putFloat(char* p, float val, int width, int precision)
+{
+  return putValue(p, val, width, precision);
+}
+
+local inline char* putDouble(char* p, double val, int width, int precision)
+{
+  return putValue(p, val, width, precision);
+}
+
+// ID: 2MASS as HHMMSSss+DDMMSSs (the first digit gives the sign), HAT as GGG-NNNNNNN (the last three digits give
+// the field)
+local char* putID(char* p, long id, IDType type)
+{
+  if(type==TMASS)
+    {
+      char str[24] = {0};
+      putLong(str, id);
+      char tmassID[16];
+      memcpy(tmassID, str+1, 8);
+      tmassID[8] = str[0]=='1' ? '+' : '-';
+      memcpy(tmassID+9, str+9, 7);
+      // a short ID ends at its last digit
+      for (int i = 0; i < 16 && tmassID[i] != '\0'; i++)
+        *p++ = tmassID[i];
+      return p;
+    }
+  if(type==HAT)
     {
-      char hatID[20];
-      char str[20];
-      sprintf(str,"%ld",id);
-      hatID[0]=str[strlen(str)-3];
-      hatID[1]=str[strlen(str)-2];
-      hatID[2]=str[strlen(str)-1];
-      hatID[3]='-';
-
-      unsigned int i;
-      for(i = 0; i<strlen(str)-3;i++)
-	{
-	  hatID[4+i]=str[i];
-	}
-      hatID[i+4]='\0';
-      fprintf(out,"%s",hatID);
-      
+      char str[24];
+      int len = (int)(putLong(str, id) - str);
+      if (len < 3)
+        return putLong(p, id);
+      memcpy(p, str+len-3, 3);
+      p[3] = '-';
+      memcpy(p+4, str, len-3);
+      return p + len + 1;
     }
-  printDouble(out,star->ra," %14.10f");
-  printDouble(out,star->dec," %14.10f");
-  printDouble(out,star->ra_error," %14.10f");
-  printDouble(out,star->dec_error," %14.10f");
-  printDouble(out,star->parallax," %9.4f");
-  printDouble(out,star->parallax_error," %9.4f");
-  printDouble(out,star->pmra," %14.10f");
-  printDouble(out,star->pmdec," %14.10f");
-  printDouble(out,star->pmra_error," %14.10f");
-  printDouble(out,star->pmdec_error," %14.10f");
-  printDouble(out,star->ref_epoch," %5.1f");
-  printDouble(out,star->astrometric_excess_noise," %14.10f");
-  printDouble(out,star->astrometric_excess_noise_sig," %14.10f");
-  if(star->astrometric_primary_flag)
-    fprintf(out," true");
+  return putLong(p, id);
+}
+
+// default print options
+local char* formatCommon(char* p, const gaiastar* star, long id,IDType type){
+  if(id==0)
+    id = star->source_id;
+  p = putID(p, id, type);
+  p = putDouble(p,star->ra,14,10);
+  p = putDouble(p,star->dec,14,10);
+  p = putDouble(p,star->ra_error,14,10);
+  p = putDouble(p,star->dec_error,14,10);
+  p = putDouble(p,star->parallax,9,4);
+  p = putDouble(p,star->parallax_error,9,4);
+  p = putDouble(p,star->pmra,14,10);
+  p = putDouble(p,star->pmdec,14,10);
+  p = putDouble(p,star->pmra_error,14,10);
+  p = putDouble(p,star->pmdec_error,14,10);
+  p = putDouble(p,star->ref_epoch,5,1);
+  p = putDouble(p,star->astrometric_excess_noise,14,10);
+  p = putDouble(p,star->astrometric_excess_noise_sig,14,10);
+  return putString(p, star->astrometric_primary_flag ? " true" : " false");
+}
+
+// default print options + additional info
+local char* formatExtra(char* p, const gaiastar* star)
+{
+  *p++ = ' ';
+  p = putLong(p, star->phot_g_n_obs);
+  p = putDouble(p,star->phot_g_mean_flux,14,10);
+  p = putDouble(p,star->phot_g_mean_flux_error,14,10);
+  p = putFloat(p,star->phot_g_mean_flux_over_error,14,10);
+  p = putFloat(p,star->phot_g_mean_mag,14,10);
+
+  *p++ = ' ';
+  p = putLong(p, star->phot_bp_n_obs);
+  p = putDouble(p,star->phot_bp_mean_flux,14,10);
+  p = putDouble(p,star->phot_bp_mean_flux_error,14,10);
+  p = putFloat(p,star->phot_bp_mean_flux_over_error,14,10);
+  p = putFloat(p,star->phot_bp_mean_mag,14,10);
+
+  *p++ = ' ';
+  p = putLong(p, star->phot_rp_n_obs);
+  p = putDouble(p,star->phot_rp_mean_flux,14,10);
+  p = putDouble(p,star->phot_rp_mean_flux_error,14,10);
+  p = putFloat(p,star->phot_rp_mean_flux_over_error,14,10);
+  p = putFloat(p,star->phot_rp_mean_mag,14,10);
+
+  p = putFloat(p,star->phot_bp_rp_excess_factor,14,10);
+  p = putDouble(p,star->radial_velocity,14,10);
+  p = putDouble(p,star->radial_velocity_error,14,10);
+  p = putString(p, star->phot_variable_flag ? " VARIABLE" : " NOT_AVAILABLE");
+
+  p = putFloat(p,star->teff_val,14,10);
+  p = putFloat(p,star->teff_percentile_lower,14,10);
+  p = putFloat(p,star->teff_percentile_upper,14,10);
+  p = putFloat(p,star->a_g_val,14,10);
+  p = putFloat(p,star->a_g_percentile_lower,14,10);
+  p = putFloat(p,star->a_g_percentile_upper,14,10);
+  p = putFloat(p,star->e_bp_min_rp_val,14,10);
+  p = putFloat(p,star->e_bp_min_rp_percentile_lower,14,10);
+  p = putFloat(p,star->e_bp_min_rp_percentile_upper,14,10);
+  p = putFloat(p,star->radius_val,14,10);
+  p = putFloat(p,star->radius_percentile_lower,14,10);
+  p = putFloat(p,star->radius_percentile_upper,14,10);
+  p = putFloat(p,star->lum_val,14,10);
+  p = putFloat(p,star->lum_percentile_lower,14,10);
+  return putFloat(p,star->lum_percentile_upper,14,10);
+}
+
+// one line of output
+local char* formatRow(char* p, const gaiastar* star, long id, IDType type, bool extra)
+{
+  p = formatCommon(p, star, id, type);
+  if (extra)
+    p = formatExtra(p, star);
+  *p++ = '\n';
+  return p;
+}
+
+// one row of a list. Without alternate IDs the rows have no ID type in front of them
+local char* formatListRow(char* p, const gaiastar stars[], bool extra, const long alternateIDs[], IDType type, int i)
+{
+  if (alternateIDs == NULL)
+    return formatRow(p, &stars[i], 0, GAIA, extra);
+  long id = alternateIDs[i];
+  if (type==TMASS && id!=0)
+    p = putString(p, "2MASS ");
+  else if(type==HAT && id!=0)
+    p = putString(p, "HAT ");
   else
-    fprintf(out," false");
+    p = putString(p, "GAIA ");
+  return formatRow(p, &stars[i], id, type, extra);
+}
+
+// formats the rows into the buffer, writing it out whenever it may not hold the next one
+local void printRows(FILE* out, const gaiastar stars[], bool extra, const long alternateIDs[], IDType type, int count)
+{
+  char* p = buffer;
+  for (int i = 0; i < count; i++)
+    {
+      if (p - buffer > PRINT_BUFFER - PRINT_MAXROW)
+        {
+          fwrite(buffer, 1, p - buffer, out);
+          p = buffer;
+        }
+      p = formatListRow(p, stars, extra, alternateIDs, type, i);
+    }
+  fwrite(buffer, 1, p - buffer, out);
 }
 
 // calls default print options
 void gaiastar_print(FILE* out, const gaiastar* star, long id,IDType type)
 {
-  print_common( out, star, id,type);
-  fendl( out );
+  char row[PRINT_MAXROW];
+  fwrite(row, 1, formatRow(row, star, id, type, false) - row, out);
 }
 
 // default print options + additional info
 void gaiastar_printextra(FILE* out, const gaiastar* star, long id,IDType type)
 {
-  print_common( out, star, id,type);
-
-  fprintf(out," %d", star->phot_g_n_obs);
-  printDouble(out,star->phot_g_mean_flux," %14.10f");
-  printDouble(out,star->phot_g_mean_flux_error," %14.10f");
-  printFloat(out,star->phot_g_mean_flux_over_error," %14.10f");
-  printFloat(out,star->phot_g_mean_mag," %14.10f");
-
-  fprintf(out," %d", star->phot_bp_n_obs);
-  printDouble(out,star->phot_bp_mean_flux," %14.10f");
-  printDouble(out,star->phot_bp_mean_flux_error," %14.10f");
-  printFloat(out,star->phot_bp_mean_flux_over_error," %14.10f");
-  printFloat(out,star->phot_bp_mean_mag," %14.10f");
-
-  fprintf(out," %d", star->phot_rp_n_obs);
-  printDouble(out,star->phot_rp_mean_flux," %14.10f");
-  printDouble(out,star->phot_rp_mean_flux_error," %14.10f");
-  printFloat(out,star->phot_rp_mean_flux_over_error," %14.10f");
-  printFloat(out,star->phot_rp_mean_mag," %14.10f");
-
-  printFloat(out,star->phot_bp_rp_excess_factor," %14.10f");
-  printDouble(out,star->radial_velocity," %14.10f");
-  printDouble(out,star->radial_velocity_error," %14.10f");
-  if(star->phot_variable_flag)
-    fprintf(out," VARIABLE");
-  else
-    fprintf(out," NOT_AVAILABLE");
-
-  printFloat(out,star->teff_val," %14.10f");
-  printFloat(out,star->teff_percentile_lower," %14.10f");
-  printFloat(out,star->teff_percentile_upper," %14.10f");
-  printFloat(out,star->a_g_val," %14.10f");
-  printFloat(out,star->a_g_percentile_lower," %14.10f");
-  printFloat(out,star->a_g_percentile_upper," %14.10f");
-  printFloat(out,star->e_bp_min_rp_val," %14.10f");
-  printFloat(out,star->e_bp_min_rp_percentile_lower," %14.10f");
-  printFloat(out,star->e_bp_min_rp_percentile_upper," %14.10f");
-  printFloat(out,star->radius_val," %14.10f");
-  printFloat(out,star->radius_percentile_lower," %14.10f");
-  printFloat(out,star->radius_percentile_upper," %14.10f");
-  printFloat(out,star->lum_val," %14.10f");
-  printFloat(out,star->lum_percentile_lower," %14.10f");
-  printFloat(out,star->lum_percentile_upper," %14.10f");
-  fprintf(out,"\n");
+  char row[PRINT_MAXROW];
+  fwrite(row, 1, formatRow(row, star, id, type, true) - row, out);
 }
 
 // print list of stars with Gaia IDs
 void gaiastar_printlist(FILE* out, const gaiastar stars[], bool extra,int count)
 {
-  if ( extra ) {
-    for (int i = 0; i < count; i++) {
-      //fprintf(out,"GAIA ");
-      const gaiastar* star = &stars[i];
-      gaiastar_printextra(out, star, 0,GAIA);
-    }
-  }
-  else {
-    for (int i = 0; i < count; i++) {
-      //fprintf(out,"GAIA ");
-      const gaiastar* star = &stars[i];
-      gaiastar_print(out, star, 0,GAIA);
-    }
-  }
+  printRows(out, stars, extra, NULL, GAIA, count);
 }
 
-// -------------------------------------------------------------------------- +                                                                                                                                                                                                 
+// -------------------------------------------------------------------------- +
 // print list of stars with specified IDs
-void gaiastar_printlist_alternateID(FILE* out, const gaiastar stars[], bool extra, const sllist* alternateIDs, IDType type,int count)
+void gaiastar_printlist_alternateID(FILE* out, const gaiastar stars[], bool extra, const long alternateIDs[], IDType type,int count)
+{
+  printRows(out, stars, extra, alternateIDs, type, count);
+}
+
+local void flushBuffer(starprinter* printer)
+{
+  fwrite(printer->buffer, 1, printer->used, printer->out);
+  printer->used = 0;
+}
+
+// appends the stars in the format of the printer to its buffer, which is written out only when it may not hold
+// the next row
+local void writeStars(starprinter* printer, const gaiastar stars[], const long alternateIDs[], int count)
 {
-  if ( extra ) {
-    const sllist* ids = alternateIDs;
-    for (int i = 0; i < count; i++ ) {
-      const gaiastar* star = &stars[i];
-      const long* id = (const long*)ids->data;
-      if (type==TMASS && *id!=0)
-	fprintf(out,"2MASS ");
-      else if(type==HAT && *id!=0)
-	fprintf(out,"HAT ");
+  printer->numRows += count;
+  for (int i = 0; i < count; i++)
+    {
+      if (printer->used > PRINT_BUFFER - PRINT_MAXROW)
+        flushBuffer(printer);
+      char* p = printer->buffer + printer->used;
+      if (printer->format == FORMAT_TEXT)
+        p = formatListRow(p, stars, printer->extra, alternateIDs, printer->type, i);
       else
-	fprintf(out,"GAIA ");
+        p = (char*)table_putrow((unsigned char*)p, printer->format, &stars[i], printer->extra,
+                                alternateIDs == NULL ? 0 : alternateIDs[i], printer->type);
+      printer->used = p - printer->buffer;
+    }
+}
 
-      gaiastar_printextra(out, star, *id,type);
-      ids = ids->next;
+void gaiastar_printbegin(starprinter* printer, FILE* out)
+{
+  printer->out = out;
+  printer->numRows = 0;
+  printer->tableStart = table_begin(out, printer->format, printer->extra, printer->type);
+  if (printer->tableStart < 0)
+    err_ret_failure("a FITS table can only be written to a file, use --out");
+  printer->buffer = malloc(PRINT_BUFFER);
+  if (printer->buffer == NULL)
+    err_ret_failure("cannot allocate memory for the output buffer");
+  printer->used = 0;
+}
+
+void gaiastar_printstars(starprinter* printer, const gaiastar stars[], int count)
+{
+  if (printer->type==GAIA)
+    {
+      writeStars(printer, stars, NULL, count);
+      return;
+    }
+  long* altIDs = starListToIDs(stars, printer->type, count);
+  writeStars(printer, stars, altIDs, count);
+  free(altIDs);
+}
+
+// prints each star as it is found. The stars that need an alternate ID are kept until a batch of
+// PRINT_BATCH is full, then their IDs are looked up together
+bool gaiastar_printvisit(const gaiastar* star, void* args)
+{
+  starprinter* printer = (starprinter*)args;
+  if (printer->type==GAIA)
+    {
+      writeStars(printer, star, NULL, 1);
+      return false;
     }
-  }
-  else {
-    const sllist* ids = alternateIDs;
-    for (int i = 0; i<count; i++) {
-      const gaiastar* star = &stars[i];
-      const long* id = (const long*)ids->data;
-      if (type==TMASS && *id!=0)
-        fprintf(out,"2MASS ");
-      else if(type==HAT && *id!=0)
-	fprintf(out,"HAT ");
-      else
-	fprintf(out,"GAIA ");
 
-      gaiastar_print(out, star, *id,type);
-      ids = ids->next;
+  if (printer->pending == NULL)
+    {
+      printer->pending = malloc(PRINT_BATCH*sizeof(gaiastar));
+      if (printer->pending == NULL)
+        err_ret_failure("cannot allocate memory for %d stars", PRINT_BATCH);
+      printer->numPending = 0;
     }
-  }
+  printer->pending[printer->numPending++] = *star;
+  if (printer->numPending == PRINT_BATCH)
+    gaiastar_printflush(printer);
+  return false;
+}
+
+void gaiastar_printflush(starprinter* printer)
+{
+  if (printer->pending == NULL)
+    return;
+  if (printer->numPending > 0)
+    gaiastar_printstars(printer, printer->pending, printer->numPending);
+  free(printer->pending);
+  printer->pending = NULL;
+  printer->numPending = 0;
+}
+
+void gaiastar_printend(starprinter* printer)
+{
+  gaiastar_printflush(printer);
+  if (printer->out == NULL)
+    return;
+  flushBuffer(printer);
+  free(printer->buffer);
+  printer->buffer = NULL;
+  table_end(printer->out, printer->format, printer->tableStart, printer->numRows, printer->extra, printer->type);
 }
 
 // print header
@@ -251,19 +412,22 @@ void gaiastar_printheader(FILE* out, bool extra, IDType outType)
   else
     idString = "2MASS";
 
-  // ID and position                                                                                                                                                                                                                                                            
-  fprintf(out, "%s ID[1] RA[deg][2] Dec[deg][3] RAError[mas][4] DecError[mas][5] Parallax[mas][6] Parallax_error[mas][7] PM_RA[mas/yr][8] PM_Dec[mas/year][9] PMRA_error[mas/yr][10] PMDec_error[mas/yr][11] Ref_Epoch[yr][12]",idString);
-  fprintf(out, " AstExcNoise[mas][13] AstExcNoiseSig[14] AstPriFlag[15] ");
+  // the columns of gaia2table.h numbered from 1, the default ones end with a space
+  for (int c = 0; c < (extra ? GAIA2_NCOLUMNS : GAIA2_NDEFAULTCOLUMNS); c++)
+    {
+      const gaiacolumn* col = &gaia2columns[c];
+      if (c == 0)
+        fprintf(out, "%s ", idString);
+      else if (c != GAIA2_NDEFAULTCOLUMNS)
+        fputc(' ', out);
+      fputs(col->name, out);
+      if (col->unit != NULL)
+        fprintf(out, "[%s]", col->unit);
+      fprintf(out, "[%d]", c + 1);
+      if (c == GAIA2_NDEFAULTCOLUMNS - 1)
+        fputc(' ', out);
+    }
 
-  if (!extra) {
+  if (!extra)
     fendl( out );
-    return;
-  }
-
-
-  fprintf(out, "phot_g_n_obs[16] phot_g_mean_flux[17] phot_g_mean_flux_error[18] phot_g_mean_flux_over_error[19] phot_g_mean_mag[20] phot_bp_n_obs[21] phot_bp_mean_flux[22] phot_bp_mean_flux_error[23] phot_bp_mean_flux_over_error[24] phot_bp_mean_mag[25] ");
-  fprintf(out, "phot_rp_n_obs[26] phot_rp_mean_flux[27] phot_rp_mean_flux_error[28] phot_rp_mean_flux_over_error[29] phot_rp_mean_mag[30] phot_bp_rp_excess_factor[31] radial_velocity[32] radial_velocity_error[33] phot_variable_flag[34] teff_val[35] teff_percentile_lower[36] ");
-  fprintf(out, "teff_percentile_upper[37] a_g_val[38] a_g_percentile_lower[39] a_g_percentile_upper[40] e_bp_min_rp_val[41] e_bp_min_rp_percentile_lower[42] e_bp_min_rp_percentile_upper[43] radius_val[44] radius_percentile_lower[45] radius_percentile_upper[46] lum_val[47] ");
-  fprintf(out, "lum_percentile_lower[48] lum_percentile_upper[49]");
 }
-
@@ -1,13 +1,48 @@
 #include <stdbool.h>
 
 #include "gaia2ret.h"
-#include "sllist.h"
+#include "gaia2table.h"
 
 // print list of stars with Gaia ID
 void gaiastar_printlist(FILE* out,const gaiastar stars[], bool extra,int count);
 
 // print list of stars with specified ID type
-void gaiastar_printlist_alternateID(FILE* out, const gaiastar stars[], bool extra, const sllist* alternateIDs, IDType type,int count);
+void gaiastar_printlist_alternateID(FILE* out, const gaiastar stars[], bool extra, const long alternateIDs[], IDType type,int count);
+
+// stars a streamed query keeps for one batched lookup of their alternate IDs
+#define PRINT_BATCH 16384
+
+// output of a query in one of the formats of gaia2table.h. pending and numPending start at NULL and 0,
+// the other fields after the format are set by gaiastar_printbegin
+typedef struct
+{
+  FILE* out;
+  bool extra;
+  IDType type;
+  outformat format;
+  gaiastar* pending;     // stars waiting for their alternate IDs
+  int numPending;
+  long tableStart;       // where the binary table starts in out
+  long numRows;
+  char* buffer;          // rows not written yet, PRINT_BUFFER bytes
+  long used;
+} starprinter;
+
+// starts the output on out: the headers of a binary table, the text header is printed by the caller
+void gaiastar_printbegin(starprinter* printer, FILE* out);
+
+// prints count stars with the ID type of the printer, looking up their alternate IDs in one batch
+void gaiastar_printstars(starprinter* printer, const gaiastar stars[], int count);
+
+// visitor printing each star as it is found (args is a starprinter). The rows are buffered and with an
+// alternate ID type the stars are printed in batches, gaiastar_printend must be called at the end of the query
+bool gaiastar_printvisit(const gaiastar* star, void* args);
+
+// prints the stars still waiting for their alternate IDs
+void gaiastar_printflush(starprinter* printer);
+
+// prints the stars still waiting, writes out the buffer and completes a binary table
+void gaiastar_printend(starprinter* printer);
 
 // print header
 void gaiastar_printheader(FILE* out, bool extra, IDType outType);
@@ -1,7 +1,68 @@
 #include <stdbool.h>
+#include <math.h>
 
 #include "gaiastar.h"
 #include "pmotion.h"
+#include "gaia2kernel.h"
+#include "mmath.h"
+#include "utils.h"
+
+// describes a field of the gaiastar struct from the astrometric or the photometric block
+#define GAIA_AST(name) { #name, offsetof(gaiastar, name), sizeof(((gaiastar*)0)->name), offsetof(gaiastar_ast, name) }
+#define GAIA_PHOT(name) { #name, offsetof(gaiastar, name), sizeof(((gaiastar*)0)->name), offsetof(gaiastar_phot, name) }
+
+const gaiafield gaiastar_fields[GAIASTAR_NFIELDS] =
+{
+  GAIA_AST(source_id),
+  GAIA_AST(ref_epoch),
+  GAIA_AST(ra),
+  GAIA_AST(ra_error),
+  GAIA_AST(dec),
+  GAIA_AST(dec_error),
+  GAIA_AST(parallax),
+  GAIA_AST(parallax_error),
+  GAIA_AST(pmra),
+  GAIA_AST(pmra_error),
+  GAIA_AST(pmdec),
+  GAIA_AST(pmdec_error),
+  GAIA_AST(astrometric_excess_noise),
+  GAIA_AST(astrometric_excess_noise_sig),
+  GAIA_AST(astrometric_primary_flag),
+  GAIA_PHOT(phot_g_n_obs),
+  GAIA_PHOT(phot_g_mean_flux),
+  GAIA_PHOT(phot_g_mean_flux_error),
+  GAIA_PHOT(phot_g_mean_flux_over_error),
+  GAIA_PHOT(phot_g_mean_mag),
+  GAIA_PHOT(phot_bp_n_obs),
+  GAIA_PHOT(phot_bp_mean_flux),
+  GAIA_PHOT(phot_bp_mean_flux_error),
+  GAIA_PHOT(phot_bp_mean_flux_over_error),
+  GAIA_PHOT(phot_bp_mean_mag),
+  GAIA_PHOT(phot_rp_n_obs),
+  GAIA_PHOT(phot_rp_mean_flux),
+  GAIA_PHOT(phot_rp_mean_flux_error),
+  GAIA_PHOT(phot_rp_mean_flux_over_error),
+  GAIA_PHOT(phot_rp_mean_mag),
+  GAIA_PHOT(phot_bp_rp_excess_factor),
+  GAIA_PHOT(radial_velocity),
+  GAIA_PHOT(radial_velocity_error),
+  GAIA_PHOT(phot_variable_flag),
+  GAIA_PHOT(teff_val),
+  GAIA_PHOT(teff_percentile_lower),
+  GAIA_PHOT(teff_percentile_upper),
+  GAIA_PHOT(a_g_val),
+  GAIA_PHOT(a_g_percentile_lower),
+  GAIA_PHOT(a_g_percentile_upper),
+  GAIA_PHOT(e_bp_min_rp_val),
+  GAIA_PHOT(e_bp_min_rp_percentile_lower),
+  GAIA_PHOT(e_bp_min_rp_percentile_upper),
+  GAIA_PHOT(radius_val),
+  GAIA_PHOT(radius_percentile_lower),
+  GAIA_PHOT(radius_percentile_upper),
+  GAIA_PHOT(lum_val),
+  GAIA_PHOT(lum_percentile_lower),
+  GAIA_PHOT(lum_percentile_upper)
+};
 
 // compare function for two gaia stars to see which as the greater ra value. Used for sorting
 int starcmp(const void * a, const void * b)
@@ -17,13 +78,112 @@ int starcmp(const void * a, const void * b)
     return 0;
 }
 
-// precess according to given equinox
-void gaia2_precesslist(gaiastar stars[], double JD/* Julian days */,int count)
+// stars are propagated in blocks of this many
+#define PROPAGATE_BLOCK 256
+
+// epoch of the positions of the zone files
+static double refEpoch = GAIA2_REFEPOCH;
+
+double gaia2_refepoch(void)
+{
+  return refEpoch;
+}
+
+void gaia2_setrefepoch(double epoch)
 {
-  for(int i = 0; i < count; i++)
+  refEpoch = epoch;
+}
+
+// the precession matrix is built once for the whole list and the stars go through kern_propagate block by block
+void gaia2_propagatelist(gaiastar stars[], int count, const double *epoch, const double *JD)
+{
+  if (epoch == NULL && JD == NULL)
+    return;
+
+  double P[9];
+  if (JD != NULL)
+    pmotion_precessmatrix2000(*JD, P);
+  const double tdiff = epoch != NULL ? *epoch - refEpoch : 0;
+
+  double ra[PROPAGATE_BLOCK], dec[PROPAGATE_BLOCK], pmra[PROPAGATE_BLOCK], pmdec[PROPAGATE_BLOCK];
+  for (int start = 0; start < count; start += PROPAGATE_BLOCK)
     {
-      gaiastar* star = &stars[i];
-      pmotion_precess2000(&star->ra,&star->dec,JD,0,0,true);
+      int n = count - start < PROPAGATE_BLOCK ? count - start : PROPAGATE_BLOCK;
+      for (int i = 0; i < n; i++)
+        {
+          ra[i] = stars[start+i].ra;
+          dec[i] = stars[start+i].dec;
+          pmra[i] = stars[start+i].pmra;
+          pmdec[i] = stars[start+i].pmdec;
+        }
+      kern_propagate(ra, dec, epoch != NULL ? pmra : NULL, pmdec, n, tdiff, JD != NULL ? P : NULL);
+      for (int i = 0; i < n; i++)
+        {
+          stars[start+i].ra = ra[i];
+          stars[start+i].dec = dec[i];
+        }
     }
 }
 
+// every second bit of v, starting with the lowest one
+local int evenBits(long v)
+{
+  int result = 0;
+  for (int b = 0; b < GAIA2_HEALPIX_LEVEL; b++)
+    result |= (int)((v >> 2*b) & 1) << b;
+  return result;
+}
+
+// pixel center of the nested scheme as pix2ang_nest of the HEALPix library: the pixel number is the base face
+// and the interleaved bits of the x and y position within the face, the ring and the position along the
+// ring give z = cos(theta) and phi
+void gaia2_healpixpos(long source_id, double *ra, double *dec)
+{
+  static const int jrll[12] = {2,2,2,2,3,3,3,3,4,4,4,4};
+  static const int jpll[12] = {1,3,5,7,0,2,4,6,1,3,5,7};
+  const long nside = 1L << GAIA2_HEALPIX_LEVEL;
+  const long npface = nside*nside;
+  const double fact2 = 4.0/(12*npface);
+  const double fact1 = 2*nside*fact2;
+
+  long pix = source_id >> GAIA2_HEALPIX_SHIFT;
+  int face = (int)(pix >> 2*GAIA2_HEALPIX_LEVEL);
+  if (face < 0 || face > 11)
+    face = 0;
+  long ipf = pix & (npface-1);
+  long ix = evenBits(ipf);
+  long iy = evenBits(ipf >> 1);
+
+  // ring number counted from the north pole
+  long jr = jrll[face]*nside - ix - iy - 1;
+  long nr;
+  double z;
+  int kshift;
+  if (jr < nside)
+    {
+      nr = jr;
+      z = 1 - nr*nr*fact2;
+      kshift = 0;
+    }
+  else if (jr > 3*nside)
+    {
+      nr = 4*nside - jr;
+      z = nr*nr*fact2 - 1;
+      kshift = 0;
+    }
+  else
+    {
+      nr = nside;
+      z = (2*nside - jr)*fact1;
+      kshift = (jr - nside) & 1;
+    }
+
+  long jp = (jpll[face]*nr + ix - iy + 1 + kshift)/2;
+  if (jp > 4*nside)
+    jp -= 4*nside;
+  if (jp < 1)
+    jp += 4*nside;
+
+  *ra = RAD2DEG( (jp - (kshift+1)*0.5)*(PI/2/nr) );
+  *dec = 90.0 - RAD2DEG( acos(z) );
+}
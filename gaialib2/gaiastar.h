@@ -2,6 +2,7 @@
 #define GAIA_STAR_H__
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "sllist.h"
 
@@ -65,12 +66,165 @@ typedef struct
 
 } gaiastar;
 
+// the default astrometric block of a gaiastar, stored on its own in the sortedAst zone files
+typedef struct
+{
+  long source_id;
+  double ref_epoch;
+  double ra;
+  double ra_error;
+  double dec;
+  double dec_error;
+  double parallax;
+  double parallax_error;
+  double pmra;
+  double pmra_error;
+  double pmdec;
+  double pmdec_error;
+  double astrometric_excess_noise;
+  double astrometric_excess_noise_sig;
+  bool astrometric_primary_flag;
+} gaiastar_ast;
+
+// the photometry and astrophysical parameters of a gaiastar (printed with --extra), stored in the sortedPhot
+// zone files in the same order as sortedAst
+typedef struct
+{
+  int phot_g_n_obs;
+  double phot_g_mean_flux;
+  double phot_g_mean_flux_error;
+  float phot_g_mean_flux_over_error;
+  float phot_g_mean_mag;
+  int phot_bp_n_obs;
+  double phot_bp_mean_flux;
+  double phot_bp_mean_flux_error;
+  float phot_bp_mean_flux_over_error;
+  float phot_bp_mean_mag;
+  int phot_rp_n_obs;
+  double phot_rp_mean_flux;
+  double phot_rp_mean_flux_error;
+  float phot_rp_mean_flux_over_error;
+  float phot_rp_mean_mag;
+  float phot_bp_rp_excess_factor;
+  double radial_velocity;
+  double radial_velocity_error;
+  bool phot_variable_flag;
+  float teff_val;
+  float teff_percentile_lower;
+  float teff_percentile_upper;
+  float a_g_val;
+  float a_g_percentile_lower;
+  float a_g_percentile_upper;
+  float e_bp_min_rp_val;
+  float e_bp_min_rp_percentile_lower;
+  float e_bp_min_rp_percentile_upper;
+  float radius_val;
+  float radius_percentile_lower;
+  float radius_percentile_upper;
+  float lum_val;
+  float lum_percentile_lower;
+  float lum_percentile_upper;
+} gaiastar_phot;
+
+
+// epoch of the Gaia DR2 positions [years], the default of gaia2_refepoch. EDR3 and DR3 are at 2016.0
+#define GAIA2_REFEPOCH 2015.5
+
+// index of each gaiastar field in gaiastar_fields, in the order of the struct
+typedef enum
+{
+  GAIA_SOURCE_ID,
+  GAIA_REF_EPOCH,
+  GAIA_RA,
+  GAIA_RA_ERROR,
+  GAIA_DEC,
+  GAIA_DEC_ERROR,
+  GAIA_PARALLAX,
+  GAIA_PARALLAX_ERROR,
+  GAIA_PMRA,
+  GAIA_PMRA_ERROR,
+  GAIA_PMDEC,
+  GAIA_PMDEC_ERROR,
+  GAIA_ASTROMETRIC_EXCESS_NOISE,
+  GAIA_ASTROMETRIC_EXCESS_NOISE_SIG,
+  GAIA_ASTROMETRIC_PRIMARY_FLAG,
+  GAIA_PHOT_G_N_OBS,
+  GAIA_PHOT_G_MEAN_FLUX,
+  GAIA_PHOT_G_MEAN_FLUX_ERROR,
+  GAIA_PHOT_G_MEAN_FLUX_OVER_ERROR,
+  GAIA_PHOT_G_MEAN_MAG,
+  GAIA_PHOT_BP_N_OBS,
+  GAIA_PHOT_BP_MEAN_FLUX,
+  GAIA_PHOT_BP_MEAN_FLUX_ERROR,
+  GAIA_PHOT_BP_MEAN_FLUX_OVER_ERROR,
+  GAIA_PHOT_BP_MEAN_MAG,
+  GAIA_PHOT_RP_N_OBS,
+  GAIA_PHOT_RP_MEAN_FLUX,
+  GAIA_PHOT_RP_MEAN_FLUX_ERROR,
+  GAIA_PHOT_RP_MEAN_FLUX_OVER_ERROR,
+  GAIA_PHOT_RP_MEAN_MAG,
+  GAIA_PHOT_BP_RP_EXCESS_FACTOR,
+  GAIA_RADIAL_VELOCITY,
+  GAIA_RADIAL_VELOCITY_ERROR,
+  GAIA_PHOT_VARIABLE_FLAG,
+  GAIA_TEFF_VAL,
+  GAIA_TEFF_PERCENTILE_LOWER,
+  GAIA_TEFF_PERCENTILE_UPPER,
+  GAIA_A_G_VAL,
+  GAIA_A_G_PERCENTILE_LOWER,
+  GAIA_A_G_PERCENTILE_UPPER,
+  GAIA_E_BP_MIN_RP_VAL,
+  GAIA_E_BP_MIN_RP_PERCENTILE_LOWER,
+  GAIA_E_BP_MIN_RP_PERCENTILE_UPPER,
+  GAIA_RADIUS_VAL,
+  GAIA_RADIUS_PERCENTILE_LOWER,
+  GAIA_RADIUS_PERCENTILE_UPPER,
+  GAIA_LUM_VAL,
+  GAIA_LUM_PERCENTILE_LOWER,
+  GAIA_LUM_PERCENTILE_UPPER
+} gaiafieldid;
+
+// number of gaiastar fields and of the default astrometric ones (source_id ... astrometric_primary_flag)
+#define GAIASTAR_NFIELDS 49
+#define GAIASTAR_NASTROMETRIC 15
+
+// name, offset and size of a gaiastar field, used to read and write the column and split layouts.
+// splitoffset is the offset of the field in gaiastar_ast (the first GAIASTAR_NASTROMETRIC fields) or gaiastar_phot
+typedef struct
+{
+  const char* name;
+  size_t offset;
+  size_t size;
+  size_t splitoffset;
+} gaiafield;
+
+extern const gaiafield gaiastar_fields[GAIASTAR_NFIELDS];
+
+// visitor called for each star of a query as it is found. Returning true stops the query (see slwalk)
+typedef bool (*starvisitor) (const gaiastar* star, void* args);
 
 // comparing stars based on ra for sort
 int starcmp(const void * a, const void * b);
 
-// precess list according to given equinox
-void gaia2_precesslist(gaiastar stars[], double JD/* Julian days */,int count);
+// applies proper motion up to epoch [years] and then precession to equinox JD to a list of stars, either may be NULL
+void gaia2_propagatelist(gaiastar stars[], int count, const double *epoch, const double *JD);
+
+// epoch [years] of the positions of the catalog, which the proper motions are applied from
+double gaia2_refepoch(void);
+
+// sets the epoch of the positions for a catalog of a later release, see gaia2_refepoch
+void gaia2_setrefepoch(double epoch);
+
+// a source_id holds the index of the level 12 HEALPix pixel (nested scheme) of the source: source_id / 2^35
+#define GAIA2_HEALPIX_LEVEL 12
+#define GAIA2_HEALPIX_SHIFT 35
+
+// the stars are within this distance [deg] of the center of their pixel: the largest pixel radius at level 12
+// (0.015 deg) and a margin for sources that have moved out of the pixel they were named after
+#define GAIA2_HEALPIX_RADIUS 0.025
+
+// ra and dec [deg] of the center of the HEALPix pixel encoded in a source_id
+void gaia2_healpixpos(long source_id, double *ra, double *dec);
 
 #endif
 
@@ -231,4 +231,40 @@ void pmotion_precess2000(
     *dec = RAD2DEG( Dec );
 }
 
+void pmotion_precessmatrix2000(
+    real            JD,         /* final epoch [actually years] */
+    real            P[9]        /* out, by rows */
+)
+{
+    // the angles of pmotion_precess2000: the position is turned by xi around the pole,
+    // by theta towards the pole and by zeta around the new pole
+
+    real t = ( JD - 2000 ) / 100;
+
+    real lincorr = 2306.2181 * t;
+
+    real xi =   lincorr + 0.30188 * t * t + 0.017998 * t * t * t;
+    real zeta = lincorr + 1.09468 * t * t + 0.018203 * t * t * t;
+    real theta = 2004.3109 * t - 0.42665 * t * t  - 0.041833 * t * t * t;
+
+    xi = DEG2RAD( ARCSEC2DEG( xi ) );
+    zeta = DEG2RAD( ARCSEC2DEG( zeta ) );
+    theta = DEG2RAD( ARCSEC2DEG( theta ) );
+
+    real cx = cos( xi ), sx = sin( xi );
+    real cz = cos( zeta ), sz = sin( zeta );
+    real ct = cos( theta ), st = sin( theta );
+
+    // P = Rz(zeta) * Ry(theta) * Rz(xi)
+    P[0] =  cz * ct * cx - sz * sx;
+    P[1] = -cz * ct * sx - sz * cx;
+    P[2] = -cz * st;
+    P[3] =  sz * ct * cx + cz * sx;
+    P[4] = -sz * ct * sx + cz * cx;
+    P[5] = -sz * st;
+    P[6] =  st * cx;
+    P[7] = -st * sx;
+    P[8] =  ct;
+}
+
 /* ========================================================================= */
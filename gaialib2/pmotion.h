@@ -70,5 +70,11 @@ void    pmotion_precess2000(
             bool            use_ang_pm  /* use [mas/yr] (true) or [ms/yr] */
         );
 
+/* precession from J2000.0 as a rotation matrix of unit vectors, same angles as pmotion_precess2000 */
+void    pmotion_precessmatrix2000(
+            real            JD,         /* final epoch [actually years] */
+            real            P[9]        /* out, by rows */
+        );
+
 /* ========================================================================= */
 #endif // PROPER_MOTION_H__